@@ -8,6 +8,20 @@
 * Assumption:
 * Integers are unique inside the entire file.
 *
+* Usage: bitsort [--range N] [--mem-budget BYTES]
+* Keys are in [0, N), N defaults to 1000000 and can be up to 2^32.
+* With --mem-budget the bitmap is kept within BYTES (K, M, G suffixes)
+* by sorting one slice of the key range per pass over input.txt.
+* With --threads N (0 for one per core) input and output are split
+* among N threads.
+* With --counts BITS duplicates are allowed: each value is counted in
+* BITS (1, 2, 4 or 8) bits, plus a side table when the counter saturates,
+* and it's written as many times as it appears.
+* With --roaring the keys are kept in a compressed bitmap (see roaring.h),
+* whose memory depends on the number of values instead of N.
+* A missing input.txt is generated with M (default N) distinct keys,
+* from a fixed seed S, in --threads shards.
+*
 * Bibliography: Jon Bentley - Programming pearls - second edition
 */
 
@@ -16,30 +30,53 @@
 #include <stdexcept>
 #include <cstdlib>
 #include <cstring>
+#include <cstdio>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <pthread.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define DEBUG
 
+#include "roaring.h"
+
+// One bit per value, packed in 64 bit words: count() and rank() use popcount
+// and the iterator jumps over empty words and finds the next bit in a word
+// with a count trailing zeros instruction.
 struct Bitmap
 {
-    char* bm;
-    int size;
-    
-    Bitmap(int sz) : size(sz)
+    uint64_t* bm;
+    uint64_t size;
+    uint64_t words;
+
+    Bitmap(uint64_t sz) : size(sz), words((sz+63)/64)
     {
 #ifdef DEBUG
         if (!sz)
             throw std::runtime_error("Invalid size for Bitmap");
 #endif
-        bm = new char[(sz+sizeof(char)-1)/sizeof(char)];
-        memset(bm, 0, (sz+sizeof(char)-1)/sizeof(char));
+        bm = new uint64_t[words];
+        memset(bm, 0, words*sizeof(uint64_t));
     }
 
     ~Bitmap()
     {
         delete [] bm;
     }
+
+    void clear()
+    {
+        memset(bm, 0, words*sizeof(uint64_t));
+    }
     
-    void set(int i)
+    void set(uint64_t i)
     {
 #ifdef DEBUG
         if (i >= size)
@@ -47,81 +84,1063 @@ struct Bitmap
         if (get(i))
             throw std::logic_error("Duplicate entry");
 #endif
-        bm[i/sizeof(char)] |= 1 << (i % sizeof(char));
+        bm[i/64] |= uint64_t(1) << (i % 64);
+    }
+
+    // Thread safe set(): many threads can fill the same bitmap
+    void set_atomic(uint64_t i)
+    {
+#ifdef DEBUG
+        if (i >= size)
+            throw std::out_of_range("Out of range");
+#endif
+        uint64_t bit = uint64_t(1) << (i % 64);
+        uint64_t old = __sync_fetch_and_or(&bm[i/64], bit);
+#ifdef DEBUG
+        if (old & bit)
+            throw std::logic_error("Duplicate entry");
+#else
+        (void)old;
+#endif
     }
 
-    int get(int i)
+    int get(uint64_t i) const
     {
 #ifdef DEBUG
         if (i >= size)
             throw std::out_of_range("Out of range");
 #endif
-        return bm[i/sizeof(char)] && 1 << (i % sizeof(char));
+        return (bm[i/64] >> (i % 64)) & 1;
+    }
+
+    // Number of values in the bitmap
+    uint64_t count() const
+    {
+        uint64_t c = 0;
+        for (uint64_t w=0; w < words; ++w)
+            c += __builtin_popcountll(bm[w]);
+        return c;
+    }
+
+    // Number of values lower than i
+    uint64_t rank(uint64_t i) const
+    {
+        uint64_t c = 0;
+        for (uint64_t w=0; w < i/64; ++w)
+            c += __builtin_popcountll(bm[w]);
+        if (i % 64)
+            c += __builtin_popcountll(bm[i/64] &
+                                      ((uint64_t(1) << (i % 64))-1));
+        return c;
+    }
+
+    // Visits the values in increasing order
+    struct iterator
+    {
+        iterator(const Bitmap* b, uint64_t w) : b(b), w(w), bits(0)
+        {
+            if (w < b->words)
+            {
+                bits = b->bm[w];
+                skip();
+            }
+        }
+
+        uint64_t operator*() const
+        {
+            return w*64 + __builtin_ctzll(bits);
+        }
+
+        iterator& operator++()
+        {
+            bits &= bits-1; // Clear the lowest bit
+            skip();
+            return *this;
+        }
+
+        bool operator!=(const iterator& o) const
+        {
+            return w != o.w || bits != o.bits;
+        }
+
+        bool operator==(const iterator& o) const
+        {
+            return !(*this != o);
+        }
+
+    private:
+        void skip()
+        {
+            while (!bits && ++w < b->words)
+                bits = b->bm[w];
+        }
+
+        const Bitmap* b;
+        uint64_t w;
+        uint64_t bits;
+    };
+
+    iterator begin() const
+    {
+        return iterator(this, 0);
+    }
+
+    iterator end() const
+    {
+        return iterator(this, words);
     }
 
 #ifdef DEBUG
     void dump()
     {
         std::cout << "BM: ";
-        for (int i=0; i < size; ++i)
-            std::cout << (bm[i/sizeof(char)]
-            && 1 << ( (i % sizeof(char)) ) ? 1 : 0 );
+        for (uint64_t i=0; i < size; ++i)
+            std::cout << get(i);
         std::cout << std::endl;
     }
 #endif
 
 private:
-    // Don't want use them because of char* bm
+    // Don't want use them because of uint64_t* bm
     Bitmap(const Bitmap &);
     Bitmap& operator=(const Bitmap&);
 };
 
-void generate_random_source(int len)
+// A counter of bits bits (1, 2, 4 or 8) per value packed in 64 bit words,
+// to sort inputs with duplicates. A counter saturates at its maximum and
+// the further occurrences of its value are counted in the overflow table,
+// which stays small unless many values are repeated a lot.
+struct CountingBitmap
 {
-    // Generate in reversed order all the integers
-    // from 0 to LEN-1
-    std::cout << "Generating... ";
-    std::fstream f("input.txt", std::ios_base::out);
-    Bitmap bitmap(len);
+    uint64_t* bm;
+    uint64_t size;
+    uint64_t words;
+    int bits;
+    uint64_t max;
+    std::map<uint64_t, uint64_t> overflow;
+
+    CountingBitmap(uint64_t sz, int bits) : size(sz), bits(bits),
+                                            max((1 << bits)-1)
+    {
 #ifdef DEBUG
-    int counter=0;
+        if (!sz)
+            throw std::runtime_error("Invalid size for CountingBitmap");
+        if (bits != 1 && bits != 2 && bits != 4 && bits != 8)
+            throw std::runtime_error("Invalid bits for CountingBitmap");
 #endif
-    for (int i=0; i<len; ++i)
+        words = (sz*bits+63)/64;
+        bm = new uint64_t[words];
+        memset(bm, 0, words*sizeof(uint64_t));
+    }
+
+    ~CountingBitmap()
+    {
+        delete [] bm;
+    }
+
+    // Counts one more occurrence of i
+    void set(uint64_t i)
+    {
+#ifdef DEBUG
+        if (i >= size)
+            throw std::out_of_range("Out of range");
+#endif
+        const int shift = i*bits % 64;
+        if (((bm[i*bits/64] >> shift) & max) < max)
+            bm[i*bits/64] += uint64_t(1) << shift;
+        else
+            ++overflow[i];
+    }
+
+    // Occurrences of i
+    uint64_t get(uint64_t i) const
     {
-        unsigned int tmp=0;
-        while(1) // Find an unique random number
-        {
 #ifdef DEBUG
-            ++counter;
+        if (i >= size)
+            throw std::out_of_range("Out of range");
 #endif
-            // RAND_MAX is granted to be at least 32767 (16bit)
-            // So i'm making sure for generating at least 2^32 integers
-            tmp = (unsigned int)(rand() << 16 | rand()) % len;
-            if (bitmap.get(tmp) == 0)
+        uint64_t c = (bm[i*bits/64] >> (i*bits % 64)) & max;
+        if (c == max)
+        {
+            std::map<uint64_t, uint64_t>::const_iterator o = overflow.find(i);
+            if (o != overflow.end())
+                c += o->second;
+        }
+        return c;
+    }
+
+    // Visits the values that occurred at least once in increasing order
+    struct iterator
+    {
+        iterator(const CountingBitmap* b, uint64_t w) : b(b), w(w), fields(0)
+        {
+            if (w < b->words)
+            {
+                fields = b->bm[w];
+                skip();
+            }
+        }
+
+        uint64_t operator*() const
+        {
+            return (w*64 + __builtin_ctzll(fields))/b->bits;
+        }
+
+        // Occurrences of the current value
+        uint64_t count() const
+        {
+            return b->get(**this);
+        }
+
+        iterator& operator++()
+        {
+            // Clear the lowest non zero counter
+            const int shift = __builtin_ctzll(fields)/b->bits*b->bits;
+            fields &= ~(b->max << shift);
+            skip();
+            return *this;
+        }
+
+        bool operator!=(const iterator& o) const
+        {
+            return w != o.w || fields != o.fields;
+        }
+
+        bool operator==(const iterator& o) const
+        {
+            return !(*this != o);
+        }
+
+    private:
+        void skip()
+        {
+            while (!fields && ++w < b->words)
+                fields = b->bm[w];
+        }
+
+        const CountingBitmap* b;
+        uint64_t w;
+        uint64_t fields;
+    };
+
+    iterator begin() const
+    {
+        return iterator(this, 0);
+    }
+
+    iterator end() const
+    {
+        return iterator(this, words);
+    }
+
+private:
+    CountingBitmap(const CountingBitmap &);
+    CountingBitmap& operator=(const CountingBitmap&);
+};
+
+// Parses the unsigned decimal integers in [p, end), separated by any
+// non digit byte, and passes them to sink.set().
+//
+// Up to 8 digits are converted at once (SWAR): the digits are found with
+// a couple of masks over a 64 bit word, then pairs, quads and octets of
+// digits are merged with three multiplications.
+template <typename S> void parse_integers(const char* p, const char* end,
+                                          S& sink)
+{
+    while (p < end)
+    {
+        uint64_t value = 0;
+        if (end-p >= 8)
+        {
+            uint64_t w;
+            memcpy(&w, p, 8);
+            // Non zero bytes where w is not a digit ('0' is 0x30)
+            uint64_t nondigit = ((w & 0xF0F0F0F0F0F0F0F0ULL) ^
+                                 0x3030303030303030ULL) |
+                (((w + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) ^
+                 0x3030303030303030ULL);
+            int len = nondigit ? __builtin_ctzll(nondigit)/8 : 8;
+            if (len == 0)
+            {
+                ++p;
+                continue;
+            }
+            // Little endian: the first digit is the lowest byte. Shifting
+            // left pads the number with leading zeros up to 8 digits.
+            uint64_t v = (w - 0x3030303030303030ULL) << (8*(8-len));
+            v = (v*10 + (v >> 8)) & 0x00FF00FF00FF00FFULL;
+            v = (v*100 + (v >> 16)) & 0x0000FFFF0000FFFFULL;
+            v = (v*10000 + (v >> 32)) & 0x00000000FFFFFFFFULL;
+            value = v;
+            p += len;
+            if (len < 8)
+            {
+                sink.set(value);
+                ++p;
+                continue;
+            }
+        }
+        else if (*p < '0' || *p > '9')
+        {
+            ++p;
+            continue;
+        }
+        // Tail of the buffer and numbers longer than 8 digits
+        while (p < end && *p >= '0' && *p <= '9')
+            value = value*10 + (*p++ - '0');
+        sink.set(value);
+    }
+}
+
+// Maps a regular file read only. data is NULL for an empty file.
+// Returns false if the file can't be mapped (eg. pipes).
+bool map_file(const char* file_name, const char** data, uint64_t* size)
+{
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return false;
+    }
+    *data = NULL;
+    *size = st.st_size;
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return true;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    *data = (const char*)map;
+    return true;
+}
+
+void unmap_file(const char* data, uint64_t size)
+{
+    if (data)
+        munmap((void*)data, size);
+}
+
+// Maps file_name and parses it with parse_integers.
+// Returns false if the file can't be mapped, so that the caller can read
+// it with a stream.
+template <typename S> bool parse_mapped_file(const char* file_name, S& sink)
+{
+    const char* data;
+    uint64_t size;
+    if (!map_file(file_name, &data, &size))
+        return false;
+    parse_integers(data, data+size, sink);
+    unmap_file(data, size);
+    return true;
+}
+
+// Slow path for non regular files
+template <typename S> void parse_stream(std::istream& f, S& sink)
+{
+    uint64_t tmp;
+    f >> tmp;
+    while (!f.eof() && !f.fail())
+    {
+        sink.set(tmp);
+        f >> tmp;
+    }
+}
+
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233"
+    "34353637383940414243444546474849505152535455565758596061626364656667"
+    "6869707172737475767778798081828384858687888990919293949596979899";
+
+// Number of decimal digits of v
+int digits(uint64_t v)
+{
+    int n = 1;
+    for (; v >= 10000; v /= 10000)
+        n += 4;
+    return n + (v >= 10) + (v >= 100) + (v >= 1000);
+}
+
+// Formats values one per line, two digits at a time. The digits of the
+// last value are kept: sorted values mostly share their leading digits, so
+// only the pairs below the first difference are formatted again.
+struct LineFormatter
+{
+    LineFormatter() : last(0), len(0)
+    {}
+
+    // Writes v and a newline at out, returns the end of the line
+    char* put(char* out, uint64_t v)
+    {
+        char* const end = digits+20;
+        char* p = end;
+        uint64_t a = v;
+        uint64_t b = last;
+        while (a != b || len == 0)
+        {
+            if (a < 100)
             {
-                bitmap.set(tmp);
+                if (a >= 10)
+                {
+                    p -= 2;
+                    memcpy(p, DIGIT_PAIRS + 2*a, 2);
+                }
+                else
+                {
+                    *--p = '0' + a;
+                }
+                len = end - p;
                 break;
             }
+            p -= 2;
+            memcpy(p, DIGIT_PAIRS + 2*(a % 100), 2);
+            a /= 100;
+            b /= 100;
         }
-        f << tmp << std::endl;
+        last = v;
+        memcpy(out, end-len, len);
+        out[len] = '\n';
+        return out+len+1;
     }
-    f.close();
+
+    char digits[20];
+    uint64_t last;
+    int len;
+};
+
+// Writes all the n bytes at p, going on after short writes
+bool write_all(int fd, const char* p, uint64_t n)
+{
+    while (n > 0)
+    {
+        ssize_t w = write(fd, p, n);
+        if (w < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += w;
+        n -= w;
+    }
+    return true;
+}
+
+// Writes all the n bytes at p at offset of the file
+bool pwrite_all(int fd, const char* p, uint64_t n, uint64_t offset)
+{
+    while (n > 0)
+    {
+        ssize_t w = pwrite(fd, p, n, offset);
+        if (w < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += w;
+        n -= w;
+        offset += w;
+    }
+    return true;
+}
+
+static const int WRITE_BUFFER = 1 << 20;
+
+// Writes values one per line in a file through a large buffer
+struct LineWriter
+{
+    LineWriter(const char* file_name) : offset(0), owned(true), used(0),
+                                        failed(false)
+    {
+        fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        buf = new char[WRITE_BUFFER];
+    }
+
+    // Writes from offset in the already open fd with pwrite, so that many
+    // writers can fill disjoint parts of the same file. fd is left open.
+    LineWriter(int fd, uint64_t offset) : fd(fd), offset(offset),
+                                          owned(false), used(0),
+                                          failed(false)
+    {
+        buf = new char[WRITE_BUFFER];
+    }
+
+    ~LineWriter()
+    {
+        close();
+        delete [] buf;
+    }
+
+    bool ok() const
+    {
+        return fd >= 0 && !failed;
+    }
+
+    void put(uint64_t v)
+    {
+        if (WRITE_BUFFER - used < 21)
+            flush();
+        used = formatter.put(buf+used, v) - buf;
+    }
+
+    void flush()
+    {
+        if (fd >= 0 && !(owned ? write_all(fd, buf, used) :
+                                 pwrite_all(fd, buf, used, offset)))
+            failed = true;
+        offset += used;
+        used = 0;
+    }
+
+    // Flushes and closes the file, returns ok()
+    bool close()
+    {
+        if (fd >= 0)
+        {
+            flush();
+            if (owned && ::close(fd) < 0)
+                failed = true;
+            fd = -1;
+            return !failed;
+        }
+        return false;
+    }
+
+    LineFormatter formatter;
+    int fd;
+    uint64_t offset;
+    bool owned;
+    char* buf;
+    int used;
+    bool failed;
+
+private:
+    LineWriter(const LineWriter &);
+    LineWriter& operator=(const LineWriter&);
+};
+
+// Sink for one slice of [0, range): keeps the keys in [lo, hi) only,
+// stored in bitmap from bit 0.
+struct SliceSink
+{
+    SliceSink(Bitmap& b, uint64_t lo, uint64_t hi, uint64_t range) :
+        bitmap(b), lo(lo), hi(hi), range(range)
+    {}
+
+    void set(uint64_t v)
+    {
 #ifdef DEBUG
-    std::cout << "Iterations: " << counter << std::endl;
+        // Keys out of range fail like in Bitmap::set, whatever the slice
+        if (v >= range)
+            throw std::out_of_range("Out of range");
 #endif
+        if (v >= lo && v < hi)
+            bitmap.set(v-lo);
+    }
+
+    Bitmap& bitmap;
+    uint64_t lo;
+    uint64_t hi;
+    uint64_t range;
+};
+
+// Sorts keys in [0, range) using at most mem_budget bytes for the bitmap:
+// the range is split in slices that fit in the budget and the input is
+// read once per slice, each pass writing its slice of the output in order.
+// The input must be a regular file, since it is read more than once.
+int multipass_sort(const char* input, const char* output, uint64_t range,
+                   uint64_t mem_budget)
+{
+    // Bits per slice, in whole words
+    uint64_t slice = mem_budget/sizeof(uint64_t)*64;
+    if (slice == 0)
+    {
+        std::cerr << "Memory budget too small" << std::endl;
+        return -1;
+    }
+    slice = std::min(slice, range);
+    const uint64_t passes = (range+slice-1)/slice;
+    std::cout << "Sorting in " << passes << " passes of " << slice
+              << " keys" << std::endl;
+
+    Bitmap bitmap(slice);
+    LineWriter out(output);
+    for (uint64_t lo=0; lo < range; lo += slice)
+    {
+        bitmap.clear();
+        SliceSink sink(bitmap, lo, std::min(lo+slice, range), range);
+        if (!parse_mapped_file(input, sink))
+        {
+            std::cerr << "Multiple passes need a regular input file"
+                      << std::endl;
+            return -1;
+        }
+        for (Bitmap::iterator it=bitmap.begin(); it != bitmap.end(); ++it)
+            out.put(lo + *it);
+    }
+    return out.close() ? 0 : -1;
+}
+
+struct AtomicSink
+{
+    AtomicSink(Bitmap& b) : bitmap(b)
+    {}
+
+    void set(uint64_t v)
+    {
+        bitmap.set_atomic(v);
+    }
+
+    Bitmap& bitmap;
+};
+
+// Work of one thread of parallel_sort: first the integers in [begin, end)
+// of the input are set in the shared bitmap, then the values in the words
+// [w_begin, w_end) of the bitmap are measured (bytes) and written in fd
+// from offset.
+struct SortShard
+{
+    Bitmap* bitmap;
+    const char* begin;
+    const char* end;
+    uint64_t w_begin;
+    uint64_t w_end;
+    uint64_t bytes;
+    int fd;
+    uint64_t offset;
+    bool ok;
+};
+
+void* parse_shard(void* arg)
+{
+    SortShard* s = (SortShard*)arg;
+    AtomicSink sink(*s->bitmap);
+    parse_integers(s->begin, s->end, sink);
+    return NULL;
+}
+
+void* measure_shard(void* arg)
+{
+    SortShard* s = (SortShard*)arg;
+    s->bytes = 0;
+    for (uint64_t w=s->w_begin; w < s->w_end; ++w)
+    {
+        uint64_t bits = s->bitmap->bm[w];
+        // The 64 values of a word mostly have the same number of digits
+        int len = digits(w*64);
+        if (len == digits(w*64+63))
+        {
+            s->bytes += __builtin_popcountll(bits)*(len+1);
+            continue;
+        }
+        for (; bits; bits &= bits-1)
+            s->bytes += digits(w*64 + __builtin_ctzll(bits)) + 1;
+    }
+    return NULL;
+}
+
+void* format_shard(void* arg)
+{
+    SortShard* s = (SortShard*)arg;
+    Bitmap::iterator it(s->bitmap, s->w_begin);
+    Bitmap::iterator end(s->bitmap, s->w_end);
+    LineWriter out(s->fd, s->offset);
+    for (; it != end; ++it)
+        out.put(*it);
+    s->ok = out.close();
+    return NULL;
+}
+
+// Runs fn on every shard, each in its own thread
+template <typename T> void run_shards(std::vector<T>& shards,
+                                      void* (*fn)(void*))
+{
+    std::vector<pthread_t> thds(shards.size());
+    for (size_t t=0; t < shards.size(); ++t)
+        pthread_create(&thds[t], NULL, fn, &shards[t]);
+    for (size_t t=0; t < shards.size(); ++t)
+        pthread_join(thds[t], NULL);
+}
+
+// Sorts with threads threads. The mapped input is split in byte ranges
+// that don't cut a number and each thread sets its integers in the shared
+// bitmap with an atomic or. Then each thread measures the output of a range
+// of keys and, once the offsets of the ranges are known, writes it at its
+// offset through its own LineWriter, so the output is never held in memory.
+int parallel_sort(const char* input, const char* output, uint64_t range,
+                  int threads)
+{
+    Bitmap bitmap(range);
+    std::vector<SortShard> shards(threads);
+    const char* data;
+    uint64_t size;
+    if (map_file(input, &data, &size))
+    {
+        uint64_t begin = 0;
+        for (int t=0; t < threads; ++t)
+        {
+            uint64_t end = t+1 == threads ? size : size/threads*(t+1);
+            // Move the boundary after the number it falls in
+            while (end < size && end > 0 && data[end-1] >= '0' &&
+                   data[end-1] <= '9')
+                ++end;
+            end = std::max(begin, end);
+            shards[t].bitmap = &bitmap;
+            shards[t].begin = data+begin;
+            shards[t].end = data+end;
+            begin = end;
+        }
+        run_shards(shards, parse_shard);
+        unmap_file(data, size);
+    }
+    else
+    {
+        std::fstream f(input, std::ios_base::in);
+        parse_stream(f, bitmap);
+    }
+
+    for (int t=0; t < threads; ++t)
+    {
+        shards[t].bitmap = &bitmap;
+        shards[t].w_begin = bitmap.words/threads*t;
+        shards[t].w_end = t+1 == threads ? bitmap.words :
+                                           bitmap.words/threads*(t+1);
+    }
+    run_shards(shards, measure_shard);
+
+    int fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        std::cerr << "Can't write output file" << std::endl;
+        return -1;
+    }
+    uint64_t offset = 0;
+    for (int t=0; t < threads; ++t)
+    {
+        shards[t].fd = fd;
+        shards[t].offset = offset;
+        offset += shards[t].bytes;
+    }
+    run_shards(shards, format_shard);
+
+    bool ok = close(fd) == 0;
+    for (int t=0; t < threads; ++t)
+        ok = ok && shards[t].ok;
+    if (!ok)
+    {
+        std::cerr << "Can't write output file" << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+// Parses sizes like 64M: K, M and G suffixes are powers of 1024
+uint64_t parse_size(const char* s)
+{
+    char* suffix;
+    uint64_t v = strtoull(s, &suffix, 10);
+    switch (*suffix)
+    {
+        case 'G': case 'g': v <<= 10;
+            // fall through
+        case 'M': case 'm': v <<= 10;
+            // fall through
+        case 'K': case 'k': v <<= 10;
+    }
+    return v;
+}
+
+// xoshiro256** generator by Blackman and Vigna, seeded with splitmix64
+struct Xoshiro256
+{
+    uint64_t s[4];
+
+    Xoshiro256(uint64_t seed)
+    {
+        for (int i=0; i < 4; ++i)
+        {
+            uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            s[i] = z ^ (z >> 31);
+        }
+    }
+
+    static uint64_t rotl(uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64-k));
+    }
+
+    uint64_t next()
+    {
+        const uint64_t result = rotl(s[1]*5, 7)*9;
+        const uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+};
+
+// Pseudo random permutation of [0, n): a balanced Feistel network on the
+// smallest even number of bits covering n, with round keys from rng. Images
+// past n go through the network again (cycle walking), less than 4 times on
+// average since the network covers less than 4n values. The first count
+// images are count distinct values in random order, in O(1) memory.
+struct RandomPermutation
+{
+    enum { ROUNDS = 4 };
+
+    RandomPermutation(uint64_t n, Xoshiro256& rng) : n(n), half(1)
+    {
+        while (half < 32 && (uint64_t(1) << 2*half) < n)
+            ++half;
+        mask = (uint64_t(1) << half) - 1;
+        for (int k=0; k < ROUNDS; ++k)
+            keys[k] = rng.next();
+    }
+
+    // Image of i < n
+    uint64_t operator()(uint64_t i) const
+    {
+        do
+            i = encrypt(i);
+        while (i >= n);
+        return i;
+    }
+
+private:
+    uint64_t encrypt(uint64_t x) const
+    {
+        uint64_t l = x >> half;
+        uint64_t r = x & mask;
+        for (int k=0; k < ROUNDS; ++k)
+        {
+            // splitmix64 finalizer as round function
+            uint64_t z = (r ^ keys[k]) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            z ^= z >> 31;
+            uint64_t t = l ^ (z & mask);
+            l = r;
+            r = t;
+        }
+        return (l << half) | r;
+    }
+
+    uint64_t n;
+    int half;
+    uint64_t mask;
+    uint64_t keys[ROUNDS];
+};
+
+// Shard t of threads of the input: count distinct keys among the keys
+// congruent to t modulo threads, in random order. The shard is measured
+// (bytes) first, then written in fd from offset.
+struct GenerateShard
+{
+    uint64_t range;
+    uint64_t count;
+    uint64_t seed;
+    int t;
+    int threads;
+    uint64_t bytes;
+    int fd;
+    uint64_t offset;
+    bool ok;
+    int error; // errno of a failed write
+};
+
+// Counts the bytes of the lines a LineWriter would write
+struct LineCounter
+{
+    LineCounter() : bytes(0)
+    {}
+
+    void put(uint64_t v)
+    {
+        bytes += digits(v) + 1;
+    }
+
+    uint64_t bytes;
+};
+
+// Passes the keys of shard s to out, in the same order on every call
+template <typename W> void generate_keys(const GenerateShard& s, W& out)
+{
+    const uint64_t keys = uint64_t(s.t) < s.range ?
+                          (s.range - s.t - 1)/s.threads + 1 : 0;
+    Xoshiro256 rng(s.seed + s.t);
+    RandomPermutation permutation(keys, rng);
+    for (uint64_t i=0; i < s.count; ++i)
+        out.put(permutation(i)*s.threads + s.t);
+}
+
+void* measure_generated_shard(void* arg)
+{
+    GenerateShard* s = (GenerateShard*)arg;
+    LineCounter counter;
+    generate_keys(*s, counter);
+    s->bytes = counter.bytes;
+    return NULL;
+}
+
+void* generate_shard(void* arg)
+{
+    GenerateShard* s = (GenerateShard*)arg;
+    LineWriter out(s->fd, s->offset);
+    generate_keys(*s, out);
+    s->ok = out.close();
+    s->error = s->ok ? 0 : errno;
+    return NULL;
+}
+
+// Writes count distinct random keys in [0, range) in input.txt, one per
+// line. threads shards are generated in parallel, each at its offset in the
+// file: the output only depends on seed and threads.
+// Returns false, removing the incomplete file, if it can't be written.
+bool generate_random_source(uint64_t range, uint64_t count, uint64_t seed,
+                            int threads)
+{
+    std::cout << "Generating... " << std::flush;
+    std::vector<GenerateShard> shards(threads);
+    for (int t=0; t < threads; ++t)
+    {
+        shards[t].range = range;
+        shards[t].count = count/threads + (uint64_t(t) < count%threads);
+        shards[t].seed = seed;
+        shards[t].t = t;
+        shards[t].threads = threads;
+    }
+    run_shards(shards, measure_generated_shard);
+
+    int fd = open("input.txt", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        std::cerr << "Can't create input.txt: " << strerror(errno)
+                  << std::endl;
+        return false;
+    }
+    uint64_t offset = 0;
+    for (int t=0; t < threads; ++t)
+    {
+        shards[t].fd = fd;
+        shards[t].offset = offset;
+        offset += shards[t].bytes;
+    }
+    run_shards(shards, generate_shard);
+
+    int error = close(fd) == 0 ? 0 : errno;
+    for (int t=0; t < threads; ++t)
+    {
+        if (!shards[t].ok)
+            error = shards[t].error;
+    }
+    if (error)
+    {
+        std::cerr << "Can't write input.txt: " << strerror(error)
+                  << std::endl;
+        unlink("input.txt");
+        return false;
+    }
     std::cout << "Done!" << std::endl;
+    return true;
 }
 
 static const int LEN = 1000000;
 
+void usage(const char* name)
+{
+    std::cerr << "Usage: " << name << " [--range N]"
+              << " [--mem-budget BYTES | --threads N]" << std::endl;
+    std::cerr << "       " << name << " [--range N] --counts BITS"
+              << std::endl;
+    std::cerr << "       " << name << " [--range N] --roaring" << std::endl;
+    std::cerr << "Input options: [--count M] [--seed S]" << std::endl;
+}
+
 int main(int argc, char **argv)
 {
+    uint64_t range = LEN;
+    uint64_t mem_budget = 0;
+    int threads = 1;
+    int counter_bits = 0;
+    int roaring = 0;
+    uint64_t count = 0;
+    uint64_t seed = 1;
+    static const struct option options[] = {
+        {"range", required_argument, NULL, 'r'},
+        {"mem-budget", required_argument, NULL, 'm'},
+        {"threads", required_argument, NULL, 't'},
+        {"counts", required_argument, NULL, 'c'},
+        {"roaring", no_argument, &roaring, 1},
+        {"count", required_argument, NULL, 'n'},
+        {"seed", required_argument, NULL, 's'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "r:m:t:c:n:s:", options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'r':
+                range = strtoull(optarg, NULL, 10);
+                break;
+            case 'm':
+                mem_budget = parse_size(optarg);
+                break;
+            case 't':
+                threads = atoi(optarg);
+                if (threads <= 0)
+                    threads = sysconf(_SC_NPROCESSORS_ONLN);
+                break;
+            case 'c':
+                counter_bits = atoi(optarg);
+                break;
+            case 'n':
+                count = strtoull(optarg, NULL, 10);
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 10);
+                break;
+            case 0:
+                break;
+            default:
+                usage(argv[0]);
+                return -1;
+        }
+    }
+    // Only one of --mem-budget, --threads, --counts and --roaring
+    int modes = (mem_budget != 0) + (threads > 1) + (counter_bits != 0) +
+                roaring;
+    // --counts takes a power of two up to 8
+    bool bad_counts = (counter_bits & (counter_bits-1)) || counter_bits > 8;
+    if (count == 0 || count > range)
+        count = range;
+    // Keys are 32 bit at most, the limit of RoaringBitmap's chunk table
+    bool bad_range = range == 0 || range > (uint64_t(1) << 32);
+    if (optind != argc || bad_range || modes > 1 || bad_counts)
+    {
+        usage(argv[0]);
+        return -1;
+    }
+
     // Try open/generate input.txt
     std::fstream f("input.txt", std::ios_base::in);
     if (f.fail())
     {
         f.close();
-        generate_random_source(LEN);
+        if (!generate_random_source(range, count, seed, threads))
+            return -1;
         f.open("input.txt", std::ios_base::in);
     }
     if (f.fail())
@@ -130,24 +1149,64 @@ int main(int argc, char **argv)
         return -1;
     }
     
-    // Create the bitmap
-    Bitmap bitmap(LEN);
+    if (mem_budget)
+    {
+        f.close();
+        return multipass_sort("input.txt", "output.txt", range, mem_budget);
+    }
 
-    // Read from file filling the bitmap
-    int tmp;
-    f >> tmp;
-    while (!f.eof() && !f.fail())
+    if (counter_bits)
     {
-        bitmap.set(tmp);
-        f >> tmp;
+        CountingBitmap counts(range, counter_bits);
+        if (!parse_mapped_file("input.txt", counts))
+            parse_stream(f, counts);
+        f.close();
+
+        LineWriter out("output.txt");
+        for (CountingBitmap::iterator it=counts.begin(); it != counts.end();
+             ++it)
+        {
+            for (uint64_t c=it.count(); c > 0; --c)
+                out.put(*it);
+        }
+        return out.close() ? 0 : -1;
     }
+
+    if (roaring)
+    {
+        RoaringBitmap bitmap(range);
+        if (!parse_mapped_file("input.txt", bitmap))
+            parse_stream(f, bitmap);
+        f.close();
+        bitmap.optimize();
+        std::cout << "Roaring bitmap: " << bitmap.count() << " values in "
+                  << bitmap.bytes() << " bytes" << std::endl;
+
+        LineWriter out("output.txt");
+        for (RoaringBitmap::iterator it=bitmap.begin(); it != bitmap.end();
+             ++it)
+            out.put(*it);
+        return out.close() ? 0 : -1;
+    }
+
+    if (threads > 1)
+    {
+        f.close();
+        return parallel_sort("input.txt", "output.txt", range, threads);
+    }
+
+    // Create the bitmap
+    Bitmap bitmap(range);
+
+    // Read from file filling the bitmap
+    if (!parse_mapped_file("input.txt", bitmap))
+        parse_stream(f, bitmap);
     f.close();
 
     // Write sorted output
-    f.open("output.txt", std::ios_base::out);
-    for (int i=0; i < LEN; ++i)
-        if (bitmap.get(i))
-            f << i << std::endl;
+    LineWriter out("output.txt");
+    for (Bitmap::iterator it=bitmap.begin(); it != bitmap.end(); ++it)
+        out.put(*it);
     
-    return 0;
+    return out.close() ? 0 : -1;
 };
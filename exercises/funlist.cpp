@@ -4,6 +4,7 @@
 #include <list>
 #include <cstdlib>
 #include <ctime>
+#include <unistd.h>
 #include "funlist.h"
 #include "funvector.h"
 
@@ -44,6 +45,17 @@ int main(int argc, char** argv)
     std::cerr << "FunList: " << double(stop-start)/CLOCKS_PER_SEC << std::endl;
     }
 
+    {
+    FunDList<Complex> dlist;
+    clock_t start = clock();
+    for (int i=0; i<N; ++i)
+        dlist.push_back(i);
+    while (dlist.size() > 0)
+        dlist.pop_back();
+    clock_t stop = clock();
+    std::cerr << "FunDList push_back+pop_back: " << double(stop-start)/CLOCKS_PER_SEC << std::endl;
+    }
+
     {
     std::vector<Complex> vec;
     clock_t start = clock();
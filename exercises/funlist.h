@@ -4,73 +4,77 @@
 
 #define DEFAULT_SIZE 1024
 
-template <typename T, int S=DEFAULT_SIZE> struct FunList
+// Pool of list nodes, allocated S at a time and never freed before the
+// allocator: free nodes are linked through their next pointer.
+template <typename LI, int S> struct FunAllocator
 {
-    struct LI
+    struct Page
     {
-        T val;
-        LI* next;
+        LI* lis;
+        Page* next;
     };
-    
-    struct Allocator
+
+    FunAllocator()
     {
-        struct Page
-        {
-            LI* lis;
-            Page* next;
-        };
+        phead = NULL;
+        plast = &phead;
+        first = NULL;
+    }
 
-        Allocator()
+    ~FunAllocator()
+    {
+        Page* pg=phead;
+        while(pg != NULL)
         {
-            phead = NULL;
-            plast = &phead;
-            first = NULL;
+            Page* tmp = pg;
+            pg = pg->next;                
+            delete [] tmp->lis;
+            delete tmp;
         }
+    }
 
-        ~Allocator()
-        {
-            Page* pg=phead;
-            while(pg != NULL)
-            {
-                Page* tmp = pg;
-                pg = pg->next;                
-                delete [] tmp->lis;
-                delete tmp;
-            }
-        }
 
+    LI* get()
+    {
+        if (first == NULL)
+            new_page();
+        LI* res = first;
+        first = first->next;
+        return res;
+    }
 
-        LI* get()
-        {
-            if (first == NULL)
-                new_page();
-            LI* res = first;
-            first = first->next;
-            return res;
-        }
+    void put(LI* l)
+    {
+        l->next = first;
+        first = l;
+    }
 
-        void put(LI* l)
-        {
-            l->next = first;
-            first = l;
-        }
+    void new_page()
+    {
+        Page* pg = new Page();
+        *plast = pg;
+        plast = &(pg->next);
+        first = new LI[S];
+        pg->lis = first;
+        for (int i=0; i<S-1; ++i)
+            first[i].next = &first[i+1];
+        first[S-1].next = NULL;
+    }
 
-        void new_page()
-        {
-            Page* pg = new Page();
-            *plast = pg;
-            plast = &(pg->next);
-            first = new LI[S];
-            pg->lis = first;
-            for (int i=0; i<S-1; ++i)
-                first[i].next = &first[i+1];
-            first[S-1].next = NULL;
-        }
+    Page* phead;
+    Page** plast;
+    LI* first;
+};
 
-        Page* phead;
-        Page** plast;
-        LI* first;
+template <typename T, int S=DEFAULT_SIZE> struct FunList
+{
+    struct LI
+    {
+        T val;
+        LI* next;
     };
+    
+    typedef FunAllocator<LI, S> Allocator;
 
     FunList()
     {
@@ -163,5 +167,135 @@ protected:
     LI* head;
     LI** last;
 };
+
+// Doubly linked variant of FunList: nodes also point to the previous one,
+// so pop_back, insert and erase are O(1) at the cost of a pointer per node.
+// Iterate it like FunList, from begin() following next up to end().
+template <typename T, int S=DEFAULT_SIZE> struct FunDList
+{
+    struct LI
+    {
+        T val;
+        LI* next;
+        LI* prev;
+    };
+
+    typedef FunAllocator<LI, S> Allocator;
+
+    FunDList()
+    {
+        head = NULL;
+        tail = NULL;
+        sz = 0;
+    }
+
+    void push_front(const T& v)
+    {
+        insert(head, v);
+    }
+
+    void push_back(const T& v)
+    {
+        insert(NULL, v);
+    }
+
+    void pop_front()
+    {
+        assert(head != NULL);
+        erase(head);
+    }
+
+    void pop_back()
+    {
+        assert(tail != NULL);
+        erase(tail);
+    }
+
+    // Inserts v before pos (at the end if pos is NULL), returns its node
+    LI* insert(LI* pos, const T& v)
+    {
+        LI* prev = pos ? pos->prev : tail;
+        LI* l = newLI(v, pos, prev);
+        if (prev)
+            prev->next = l;
+        else
+            head = l;
+        if (pos)
+            pos->prev = l;
+        else
+            tail = l;
+        ++sz;
+        return l;
+    }
+
+    // Removes pos, returns the node after it
+    LI* erase(LI* pos)
+    {
+        assert(pos != NULL);
+        LI* next = pos->next;
+        if (pos->prev)
+            pos->prev->next = next;
+        else
+            head = next;
+        if (next)
+            next->prev = pos->prev;
+        else
+            tail = pos->prev;
+        deleteLI(pos);
+        --sz;
+        return next;
+    }
+
+    LI* begin() const
+    {
+        return head;
+    }
+
+    LI* end() const
+    {
+        return NULL;
+    }
+
+    LI* back() const
+    {
+        return tail;
+    }
+
+    int size() const
+    {
+        return sz;
+    }
+
+    ~FunDList()
+    {
+        LI* curr = head;
+        while(curr != NULL)
+        {
+            LI* tmp = curr;
+            curr = tmp->next;
+            deleteLI(tmp);
+        }
+    }
+
+protected:
+    LI* newLI(const T& v, LI* nxt, LI* prv)
+    {
+        LI* l = allocator.get();
+        l->val = v;
+        l->next = nxt;
+        l->prev = prv;
+        return l;
+    }
+
+    void deleteLI(LI* l)
+    {
+        allocator.put(l);
+    }
+
+    Allocator allocator;
+    int sz;
+    LI* head;
+    LI* tail;
+};
 #endif
 
@@ -9,6 +9,12 @@
 * Assumption:
 * Integers are unique inside the entire vector.
 *
+* Usage: missing [-a] [-t threads] [file [max_val]]
+* With a file of native 32 bit integers finds a value of [0, max_val)
+* (default 2^32) missing from it, reading it sequentially 4 times.
+* With -a prints all the missing values in order (see find_all_missing),
+* up to max_val or, by default, up to the largest value in the file.
+*
 * Bibliography: Jon Bentley - Programming pearls - second edition
 */
 
@@ -16,6 +22,16 @@
 #include <vector>
 #include <cassert>
 #include <cstdlib>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 unsigned int on_search(std::vector<unsigned int>& input, unsigned int max_val)
 {
@@ -65,10 +81,409 @@ unsigned int on_search(std::vector<unsigned int>& input, unsigned int max_val)
     return missing;
 }
 
+// Same search as on_search, but each pass partitions the remaining part of
+// input in place around the bit, like the partition step of quicksort,
+// and goes on in the half with more missing values: no allocation and
+// O(1) extra space. The order of input changes, its values don't.
+unsigned int on_search_inplace(std::vector<unsigned int>& input,
+                               unsigned int max_val)
+{
+    int shift = 0;
+    while(max_val >> shift)
+    {
+        ++shift;
+    };
+
+    unsigned int missing=0;
+    unsigned int mask=0;
+
+    // The candidates are input[lo, hi), max_val values may be there
+    size_t lo = 0;
+    size_t hi = input.size();
+
+    while (shift--)
+    {
+        mask = 1 << shift;
+
+        // Elements without the bit to the left, with the bit to the right
+        size_t i = lo;
+        size_t j = hi;
+        while (i < j)
+        {
+            if (!(input[i] & mask))
+                ++i;
+            else if (input[j-1] & mask)
+                --j;
+            else
+                std::swap(input[i++], input[--j]);
+        }
+
+        // Values that fit in each half
+        unsigned int left_max = std::min(mask, max_val);
+        unsigned int right_max = max_val > mask ? max_val - mask : 0;
+
+        assert(i-lo <= left_max); // Left uniqueness
+        assert(hi-i <= right_max); // Right uniqueness
+        assert(left_max-(i-lo) != 0 ||
+               right_max-(hi-i) != 0); // Any missing
+
+        if (left_max-(i-lo) >= right_max-(hi-i))
+        {
+            missing = missing << 1;
+            hi = i;
+            max_val = left_max;
+        }
+        else
+        {
+            missing = missing << 1 | 1;
+            lo = i;
+            max_val = right_max;
+        }
+    }
+    return missing;
+}
+
+// Reads the file of native 32 bit integers fd in blocks, from the
+// start, calling pass.visit() on each value. Returns false on errors.
+template <typename P> bool scan_file(int fd, P& pass)
+{
+    static const int BLOCK = 1 << 16;
+    std::vector<uint32_t> block(BLOCK);
+    off_t offset = 0;
+    size_t tail = 0; // Bytes of an incomplete value left in block
+    while (true)
+    {
+        char* buf = reinterpret_cast<char*>(&block[0]);
+        ssize_t got = pread(fd, buf+tail, BLOCK*sizeof(uint32_t)-tail,
+                            offset);
+        if (got < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (got == 0)
+            return true;
+        offset += got;
+        size_t bytes = tail + got;
+        size_t n = bytes/sizeof(uint32_t);
+        for (size_t i=0; i<n; ++i)
+            pass.visit(block[i]);
+        tail = bytes - n*sizeof(uint32_t);
+        memmove(buf, buf + n*sizeof(uint32_t), tail);
+    }
+}
+
+// One pass of stream_search: counts the values with the known high bits,
+// in 256 buckets by their next 8 bits.
+struct BytePass
+{
+    BytePass(uint32_t prefix, int shift) : prefix(prefix), shift(shift)
+    {
+        std::fill(counts, counts+256, 0);
+    }
+
+    void visit(uint32_t v)
+    {
+        // shift+8 can be 32: shift in 64 bits
+        if ((uint64_t(v) >> (shift+8)) == prefix)
+            ++counts[(v >> shift) & 0xff];
+    }
+
+    uint32_t prefix;
+    int shift;
+    uint64_t counts[256];
+};
+
+// Finds a value of [0, max_val) missing from the file of unique native
+// 32 bit integers file_name, without loading it: each of the 4 sequential
+// passes counts the values sharing the known high bytes by their next byte
+// and picks a byte with less values than fit in it. Uses O(256) memory.
+// Returns false if the file can't be read or no value is missing.
+bool stream_search(const char* file_name, uint64_t max_val,
+                   uint32_t* missing)
+{
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0)
+        return false;
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    uint32_t prefix = 0;
+    for (int shift=24; shift >= 0; shift -= 8)
+    {
+        BytePass pass(prefix, shift);
+        if (!scan_file(fd, pass))
+        {
+            close(fd);
+            return false;
+        }
+
+        int b = 0;
+        for (; b < 256; ++b)
+        {
+            // Values of [0, max_val) in this bucket
+            uint64_t lo = (uint64_t(prefix) << 8 | b) << shift;
+            uint64_t width = uint64_t(1) << shift;
+            uint64_t fit = lo >= max_val ? 0 : std::min(width, max_val-lo);
+            if (pass.counts[b] < fit)
+                break;
+        }
+        if (b == 256)
+        {
+            close(fd);
+            return false;
+        }
+        prefix = prefix << 8 | b;
+    }
+    close(fd);
+    *missing = prefix;
+    return true;
+}
+
+static const uint64_t GAP_COUNTERS = 1 << 16; // Histogram size per thread
+static const uint64_t GAP_SWEEP = 1 << 26;    // Bits of the final bitmap
+
+// Work of one thread of a find_all_missing pass over [begin, end). The
+// candidate values are in the buckets of width 2^shift listed in active.
+struct GapPass
+{
+    const uint32_t* begin;
+    const uint32_t* end;
+    const std::vector<uint64_t>* active; // Sorted v >> shift of the buckets
+    int shift;
+    uint64_t max_val;
+    int bits;                     // Histogram: each bucket in 2^bits
+    std::vector<uint64_t> counts; // Histogram: counters of this thread
+    uint64_t* bitmap;             // Sweep: bit per candidate, shared
+};
+
+// Position of bucket id in active, -1 if it isn't there
+int64_t active_index(const std::vector<uint64_t>& active, uint64_t id)
+{
+    std::vector<uint64_t>::const_iterator it =
+        std::lower_bound(active.begin(), active.end(), id);
+    return it != active.end() && *it == id ? it - active.begin() : -1;
+}
+
+void* histogram_pass(void* arg)
+{
+    GapPass* p = (GapPass*)arg;
+    const int sub_shift = p->shift - p->bits;
+    const uint64_t sub_mask = (uint64_t(1) << p->bits) - 1;
+    for (const uint32_t* v=p->begin; v != p->end; ++v)
+    {
+        if (*v >= p->max_val)
+            continue;
+        int64_t a = active_index(*p->active, uint64_t(*v) >> p->shift);
+        if (a >= 0)
+            ++p->counts[a << p->bits | ((*v >> sub_shift) & sub_mask)];
+    }
+    return NULL;
+}
+
+void* sweep_pass(void* arg)
+{
+    GapPass* p = (GapPass*)arg;
+    const uint64_t mask = (uint64_t(1) << p->shift) - 1;
+    for (const uint32_t* v=p->begin; v != p->end; ++v)
+    {
+        int64_t a = active_index(*p->active, uint64_t(*v) >> p->shift);
+        if (a < 0)
+            continue;
+        uint64_t i = uint64_t(a) << p->shift | (*v & mask);
+        __sync_fetch_and_or(&p->bitmap[i/64], uint64_t(1) << (i % 64));
+    }
+    return NULL;
+}
+
+// Runs fn on every pass, each in its own thread
+void run_passes(std::vector<GapPass>& passes, void* (*fn)(void*))
+{
+    std::vector<pthread_t> thds(passes.size());
+    for (size_t t=0; t < passes.size(); ++t)
+        pthread_create(&thds[t], NULL, fn, &passes[t]);
+    for (size_t t=0; t < passes.size(); ++t)
+        pthread_join(thds[t], NULL);
+}
+
+// Finds all the values of [0, max_val) (max_val <= 2^32) missing from
+// data[0, n), in increasing order, with threads threads.
+//
+// Each histogram pass splits the buckets that still miss some values in
+// 2^bits smaller ones and counts their values, every thread on its own
+// counters, summed at the end of the pass: only the buckets with less
+// values than fit in them stay. When the remaining buckets fit in
+// GAP_SWEEP bits, or a pass kept more than half of them (too many gaps
+// to narrow down), a last pass marks their values in a bitmap and the gaps
+// are its clear bits. Assumes unique values like on_search: a duplicate
+// can hide a missing value of its bucket.
+void find_all_missing(const uint32_t* data, size_t n, uint64_t max_val,
+                      int threads, std::vector<uint32_t>* gaps)
+{
+    gaps->clear();
+    std::vector<uint64_t> active(1, 0);
+    int shift = 32;
+    std::vector<GapPass> passes(threads);
+    for (int t=0; t < threads; ++t)
+    {
+        passes[t].begin = data + n/threads*t;
+        passes[t].end = t+1 == threads ? data+n : data + n/threads*(t+1);
+        passes[t].active = &active;
+        passes[t].max_val = max_val;
+    }
+
+    while (shift > 0 && (active.size() << shift) > GAP_SWEEP)
+    {
+        int bits = 1;
+        while (bits < shift && (active.size() << (bits+1)) <= GAP_COUNTERS)
+            ++bits;
+        for (int t=0; t < threads; ++t)
+        {
+            passes[t].shift = shift;
+            passes[t].bits = bits;
+            passes[t].counts.assign(active.size() << bits, 0);
+        }
+        run_passes(passes, histogram_pass);
+
+        std::vector<uint64_t> next;
+        shift -= bits;
+        for (uint64_t b=0; b < (active.size() << bits); ++b)
+        {
+            uint64_t count = 0;
+            for (int t=0; t < threads; ++t)
+                count += passes[t].counts[b];
+            uint64_t id = active[b >> bits] << bits | (b & ((1 << bits)-1));
+            uint64_t lo = id << shift;
+            uint64_t fit = lo >= max_val ? 0 :
+                           std::min(uint64_t(1) << shift, max_val-lo);
+            if (count < fit)
+                next.push_back(id);
+        }
+        // Refining pays only while most of the buckets have no gaps
+        bool sparse = (next.size() << shift) <= (active.size() << bits <<
+                                                 shift)/2;
+        active.swap(next);
+        if (active.empty())
+            return;
+        if (!sparse)
+            break;
+    }
+
+    std::vector<uint64_t> bitmap(((active.size() << shift) + 63)/64, 0);
+    for (int t=0; t < threads; ++t)
+    {
+        passes[t].shift = shift;
+        passes[t].bitmap = &bitmap[0];
+        std::vector<uint64_t>().swap(passes[t].counts);
+    }
+    run_passes(passes, sweep_pass);
+
+    for (size_t a=0; a < active.size(); ++a)
+    {
+        uint64_t lo = active[a] << shift;
+        uint64_t fit = lo >= max_val ? 0 :
+                       std::min(uint64_t(1) << shift, max_val-lo);
+        for (uint64_t v=0; v < fit; ++v)
+        {
+            uint64_t i = a << shift | v;
+            if (!((bitmap[i/64] >> (i % 64)) & 1))
+                gaps->push_back(lo+v);
+        }
+    }
+}
+
 
 #define SIZE 1000000 // Try to increase
 int main(int argc, char** argv)
 {
+    bool all = false;
+    int threads = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "at:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'a':
+                all = true;
+                break;
+            case 't':
+                threads = atoi(optarg);
+                if (threads <= 0)
+                    threads = sysconf(_SC_NPROCESSORS_ONLN);
+                break;
+            default:
+                std::cerr << "Usage: " << argv[0]
+                          << " [-a] [-t threads] [file [max_val]]"
+                          << std::endl;
+                return 1;
+        }
+    }
+
+    // With a file of 32 bit integers, search it without loading it
+    if (optind < argc)
+    {
+        const char* file_name = argv[optind];
+        uint64_t max_val = optind+1 < argc ?
+                           strtoull(argv[optind+1], NULL, 10) :
+                           uint64_t(1) << 32;
+        if (all)
+        {
+            int fd = open(file_name, O_RDONLY);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) < 0)
+            {
+                std::cerr << "Can't open " << file_name << std::endl;
+                return 1;
+            }
+            size_t n = st.st_size/sizeof(uint32_t);
+            void* map = n ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                                 fd, 0) : NULL;
+            close(fd);
+            if (map == MAP_FAILED)
+            {
+                std::cerr << "Can't map " << file_name << std::endl;
+                return 1;
+            }
+            const uint32_t* data = (const uint32_t*)map;
+            if (optind+1 >= argc)
+            {
+                // Up to 2^32 almost every value would be missing
+                max_val = n ? uint64_t(*std::max_element(data, data+n))+1 : 0;
+            }
+            std::vector<uint32_t> gaps;
+            try
+            {
+                find_all_missing(data, n, max_val, threads, &gaps);
+            }
+            catch (const std::bad_alloc&)
+            {
+                std::cerr << "Too many missing values in " << file_name
+                          << ", try a lower max_val" << std::endl;
+                if (map)
+                    munmap(map, st.st_size);
+                return 1;
+            }
+            if (map)
+                munmap(map, st.st_size);
+            for (size_t i=0; i < gaps.size(); ++i)
+                std::cout << gaps[i] << '\n';
+            return 0;
+        }
+
+        uint32_t missing;
+        std::cout << "stream_search..." << std::endl;
+        if (!stream_search(file_name, max_val, &missing))
+        {
+            std::cerr << "No missing element found in " << file_name
+                      << std::endl;
+            return 1;
+        }
+        std::cout << "Element " << missing << " is missing" << std::endl;
+        return 0;
+    }
+
     std::vector<unsigned int> in(SIZE);
     
     // Unordered fill
@@ -90,7 +505,17 @@ int main(int argc, char** argv)
               << " at position " <<k << std::endl;
     in.erase(in.begin()+k);
 
-    // Search
+    // Search, in place first since on_search consumes the vector
+    std::cout << "on_search_inplace..." << std::endl;
+    std::cout << "Element " << on_search_inplace(in, SIZE)
+              << " is missing" << std::endl;
+
+    std::cout << "find_all_missing..." << std::endl;
+    std::vector<uint32_t> gaps;
+    find_all_missing(&in[0], in.size(), SIZE, threads, &gaps);
+    for (size_t i=0; i < gaps.size(); ++i)
+        std::cout << "Element " << gaps[i] << " is missing" << std::endl;
+
     std::cout << "on_search..." << std::endl;
     std::cout << "Element " << on_search(in, SIZE)
               << " is missing" << std::endl;
@@ -0,0 +1,380 @@
+#ifndef __roaring_h_
+#define __roaring_h_
+#include <cstring>
+#include <stdexcept>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+// Compressed bitmap for sparse key spaces (Roaring bitmap). The keys are
+// split in chunks of 64K values by their high bits, and every non empty
+// chunk keeps its low 16 bits in the smallest of three containers:
+//  - array: the sorted values, up to ARRAY_MAX of them;
+//  - bitset: 1024 words, one bit per value;
+//  - run: sorted (start, length-1) pairs of consecutive values.
+// set() only creates arrays and bitsets, and switches to a bitset already
+// at ARRAY_GROW values, since unsorted inserts in an array move half of it
+// each time; optimize() then picks the smallest container, runs included.
+// The table of chunks costs a pointer per 64K keys, everything else scales
+// with the number of values.
+struct RoaringBitmap
+{
+    enum { ARRAY_MAX = 4096, ARRAY_GROW = 1024, BITSET_WORDS = 1024 };
+
+    struct Container
+    {
+        enum Type { ARRAY, BITSET, RUN };
+
+        Container() : type(ARRAY), card(0)
+        {}
+
+        // Returns false if v was already there
+        bool add(uint16_t v)
+        {
+            if (type == RUN)
+                to_bitset();
+            if (type == ARRAY)
+            {
+                std::vector<uint16_t>::iterator it =
+                    std::lower_bound(data.begin(), data.end(), v);
+                if (it != data.end() && *it == v)
+                    return false;
+                if (card < ARRAY_GROW)
+                {
+                    data.insert(it, v);
+                    ++card;
+                    return true;
+                }
+                to_bitset();
+            }
+            uint64_t bit = uint64_t(1) << (v % 64);
+            if (words[v/64] & bit)
+                return false;
+            words[v/64] |= bit;
+            ++card;
+            return true;
+        }
+
+        bool contains(uint16_t v) const
+        {
+            if (type == ARRAY)
+                return std::binary_search(data.begin(), data.end(), v);
+            if (type == BITSET)
+                return (words[v/64] >> (v % 64)) & 1;
+            // Last run starting at or before v
+            size_t lo = 0;
+            size_t hi = data.size()/2;
+            while (lo < hi)
+            {
+                size_t mid = (lo+hi)/2;
+                if (data[2*mid] <= v)
+                    lo = mid+1;
+                else
+                    hi = mid;
+            }
+            return lo > 0 && v - data[2*(lo-1)] <= data[2*(lo-1)+1];
+        }
+
+        // Number of runs of consecutive values
+        uint32_t runs() const
+        {
+            if (type == RUN)
+                return data.size()/2;
+            uint32_t n = 0;
+            if (type == ARRAY)
+            {
+                for (uint32_t i=0; i < card; ++i)
+                    n += i == 0 || data[i] != data[i-1]+1;
+                return n;
+            }
+            uint64_t carry = 0;
+            for (int w=0; w < BITSET_WORDS; ++w)
+            {
+                // Set bits whose previous bit is clear
+                n += __builtin_popcountll(words[w] & ~(words[w] << 1 | carry));
+                carry = words[w] >> 63;
+            }
+            return n;
+        }
+
+        size_t bytes() const
+        {
+            return data.capacity()*sizeof(uint16_t) +
+                   words.capacity()*sizeof(uint64_t);
+        }
+
+        // Switches to the smallest container
+        void optimize()
+        {
+            size_t run_bytes = runs()*2*sizeof(uint16_t);
+            size_t array_bytes = card <= ARRAY_MAX ?
+                                 card*sizeof(uint16_t) : size_t(-1);
+            size_t bitset_bytes = BITSET_WORDS*sizeof(uint64_t);
+            if (run_bytes < array_bytes && run_bytes < bitset_bytes)
+                to_runs();
+            else if (array_bytes <= bitset_bytes)
+                to_array();
+            else
+                to_bitset();
+        }
+
+        void to_bitset()
+        {
+            if (type == BITSET)
+                return;
+            std::vector<uint64_t> w(BITSET_WORDS, 0);
+            if (type == ARRAY)
+            {
+                for (uint32_t i=0; i < card; ++i)
+                    w[data[i]/64] |= uint64_t(1) << (data[i] % 64);
+            }
+            else
+            {
+                for (size_t r=0; r < data.size(); r += 2)
+                    for (uint32_t v=data[r]; v <= uint32_t(data[r]+data[r+1]);
+                         ++v)
+                        w[v/64] |= uint64_t(1) << (v % 64);
+            }
+            words.swap(w);
+            std::vector<uint16_t>().swap(data);
+            type = BITSET;
+        }
+
+        void to_array()
+        {
+            if (type == ARRAY)
+                return;
+            to_bitset();
+            std::vector<uint16_t> a;
+            a.reserve(card);
+            for (int w=0; w < BITSET_WORDS; ++w)
+                for (uint64_t bits=words[w]; bits; bits &= bits-1)
+                    a.push_back(w*64 + __builtin_ctzll(bits));
+            data.swap(a);
+            std::vector<uint64_t>().swap(words);
+            type = ARRAY;
+        }
+
+        void to_runs()
+        {
+            if (type == RUN)
+                return;
+            to_bitset();
+            std::vector<uint16_t> r;
+            r.reserve(2*runs());
+            uint32_t v = 0;
+            while (v < 65536)
+            {
+                // Jump to the next set bit, then to the next clear one
+                uint64_t w = words[v/64] >> (v % 64);
+                if (!w)
+                {
+                    v = (v/64+1)*64;
+                    continue;
+                }
+                v += __builtin_ctzll(w);
+                uint32_t start = v;
+                while (v < 65536)
+                {
+                    w = ~words[v/64] >> (v % 64);
+                    if (w)
+                    {
+                        v += __builtin_ctzll(w);
+                        break;
+                    }
+                    v = (v/64+1)*64;
+                }
+                r.push_back(start);
+                r.push_back(v-1-start);
+            }
+            data.swap(r);
+            std::vector<uint64_t>().swap(words);
+            type = RUN;
+        }
+
+        Type type;
+        uint32_t card;
+        std::vector<uint16_t> data;     // ARRAY values or RUN pairs
+        std::vector<uint64_t> words;    // BITSET
+    };
+
+    RoaringBitmap(uint64_t sz) : size(sz), chunks((sz+65535)/65536, NULL)
+    {}
+
+    ~RoaringBitmap()
+    {
+        for (size_t c=0; c < chunks.size(); ++c)
+            delete chunks[c];
+    }
+
+    void set(uint64_t i)
+    {
+#ifdef DEBUG
+        if (i >= size)
+            throw std::out_of_range("Out of range");
+#endif
+        Container*& c = chunks[i >> 16];
+        if (!c)
+            c = new Container;
+        bool added = c->add(i & 0xffff);
+#ifdef DEBUG
+        if (!added)
+            throw std::logic_error("Duplicate entry");
+#else
+        (void)added;
+#endif
+    }
+
+    int get(uint64_t i) const
+    {
+#ifdef DEBUG
+        if (i >= size)
+            throw std::out_of_range("Out of range");
+#endif
+        const Container* c = chunks[i >> 16];
+        return c && c->contains(i & 0xffff);
+    }
+
+    // Number of values in the bitmap
+    uint64_t count() const
+    {
+        uint64_t n = 0;
+        for (size_t c=0; c < chunks.size(); ++c)
+            if (chunks[c])
+                n += chunks[c]->card;
+        return n;
+    }
+
+    // Memory used by the bitmap
+    uint64_t bytes() const
+    {
+        uint64_t n = sizeof(*this) + chunks.capacity()*sizeof(Container*);
+        for (size_t c=0; c < chunks.size(); ++c)
+            if (chunks[c])
+                n += sizeof(Container) + chunks[c]->bytes();
+        return n;
+    }
+
+    // Picks the smallest container for every chunk
+    void optimize()
+    {
+        for (size_t c=0; c < chunks.size(); ++c)
+            if (chunks[c])
+                chunks[c]->optimize();
+    }
+
+    // Visits the values in increasing order
+    struct iterator
+    {
+        iterator(const RoaringBitmap* r, uint64_t c) : r(r), c(c)
+        {
+            load();
+        }
+
+        uint64_t operator*() const
+        {
+            return value;
+        }
+
+        iterator& operator++()
+        {
+            const Container* k = r->chunks[c];
+            if (k->type == Container::ARRAY)
+            {
+                if (++i < k->card)
+                {
+                    value = (c << 16) | k->data[i];
+                    return *this;
+                }
+            }
+            else if (k->type == Container::BITSET)
+            {
+                bits &= bits-1;
+                while (!bits && ++i < BITSET_WORDS)
+                    bits = k->words[i];
+                if (bits)
+                {
+                    value = (c << 16) | (i*64 + __builtin_ctzll(bits));
+                    return *this;
+                }
+            }
+            else
+            {
+                if (++off > k->data[2*i+1])
+                {
+                    off = 0;
+                    i += 1;
+                }
+                if (2*i < k->data.size())
+                {
+                    value = (c << 16) | (k->data[2*i] + off);
+                    return *this;
+                }
+            }
+            ++c;
+            load();
+            return *this;
+        }
+
+        bool operator!=(const iterator& o) const
+        {
+            return c != o.c || (c < r->chunks.size() && value != o.value);
+        }
+
+        bool operator==(const iterator& o) const
+        {
+            return !(*this != o);
+        }
+
+    private:
+        // Moves to the first value of chunk c or of the next non empty one
+        void load()
+        {
+            while (c < r->chunks.size() && (!r->chunks[c] ||
+                                            !r->chunks[c]->card))
+                ++c;
+            if (c == r->chunks.size())
+                return;
+            const Container* k = r->chunks[c];
+            i = 0;
+            off = 0;
+            if (k->type == Container::BITSET)
+            {
+                bits = k->words[0];
+                while (!bits)
+                    bits = k->words[++i];
+                value = (c << 16) | (i*64 + __builtin_ctzll(bits));
+            }
+            else
+            {
+                value = (c << 16) | k->data[0];
+            }
+        }
+
+        const RoaringBitmap* r;
+        uint64_t c;         // Chunk
+        uint32_t i;         // Array index, bitset word or run
+        uint32_t off;       // Offset in the run
+        uint64_t bits;      // Bits left in the bitset word
+        uint64_t value;
+    };
+
+    iterator begin() const
+    {
+        return iterator(this, 0);
+    }
+
+    iterator end() const
+    {
+        return iterator(this, chunks.size());
+    }
+
+    uint64_t size;
+    std::vector<Container*> chunks;
+
+private:
+    RoaringBitmap(const RoaringBitmap &);
+    RoaringBitmap& operator=(const RoaringBitmap&);
+};
+
+#endif
@@ -1,5 +1,13 @@
 #include <iostream>
 #include <string>
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rotate.h"
 
 void rotate_zero(std::string& s, int count)
 {
@@ -28,25 +36,30 @@ void rotate_one(std::string& s, int count)
 
 void rotate_two(std::string& s, int count)
 {
-    // Rotate a string using just 1 char buffer
+    // Rotate a string using just 1 char buffer, following the gcd(len,
+    // count) cycles of the rotation (juggling)
     int len = s.size();
     if (count >= len)
         count %= len;
-    char c;
-    for (int i=0; i<count; ++i)
+    if (count == 0)
+        return;
+    int cycles = rotate_gcd(len, count);
+    for (int i=0; i < cycles; ++i)
     {
-        int j=i;
-        c = s[j];
-        while (j+count < len)
+        char c = s[i];
+        int j = i;
+        while (true)
         {
-            s[j] = s[j+count];
-            j += count;
+            int next = j+count < len ? j+count : j+count-len;
+            if (next == i)
+                break;
+            s[j] = s[next];
+            j = next;
         }
         s[j] = c;
     }
 }
 
-
 void reverse(std::string& s, int i, int j)
 {
     // Utility function for rotate three...
@@ -58,25 +71,120 @@ void reverse(std::string& s, int i, int j)
         j=t;
     }
 
-    while(i < --j)
+    if (i < j)
+        reverse_bytes(&s[0]+i, &s[0]+j); // See rotate.h
+}
+
+void rotate_three(std::string& s, int count)
+{
+    // Triple reversal, all three reversals in one sweep (see rotate.h)
+    if (s.empty())
+        return;
+    reverse_rotate(&s[0], &s[0]+count, &s[0]+s.size());
+}
+
+// Rotates the file file_name left by count bytes in place: it's mapped
+// read write and rotated with parallel_rotate, which needs no extra memory
+// besides the page cache.
+bool rotate_file(const char* file_name, long long count, int threads)
+{
+    int fd = open(file_name, O_RDWR);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0)
     {
-        char t = s[i];
-        s[i] = s[j];
-        s[j] = t;
-        ++i;
+        close(fd);
+        return false;
     }
+    const long long size = st.st_size;
+    count %= size ? size : 1;
+    if (count < 0)
+        count += size;
+    if (count == 0)
+    {
+        close(fd);
+        return true;
+    }
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+    char* data = (char*)map;
+    parallel_rotate(data, data+count, data+size, threads);
+    return munmap(map, size) == 0;
 }
 
-void rotate_three(std::string& s, int count)
+// Rotates n values of v around k with ::rotate, checking that it picks
+// algorithm and gets the same result as std::rotate
+template <typename T> bool check_rotate(const char* name, std::vector<T> v,
+                                        size_t k, RotateAlgorithm algorithm)
 {
-    // Reverse a string in place
-    reverse(s, 0, count);
-    reverse(s, count, s.size());
-    reverse(s, 0, s.size());
+    std::vector<T> expected(v);
+    std::rotate(expected.begin(), expected.begin()+k, expected.end());
+    bool ok = rotate_algorithm<T>(v.size(), k) == algorithm;
+    typename std::vector<T>::iterator it =
+        ::rotate(v.begin(), v.begin()+k, v.end());
+    ok = ok && v == expected && it == v.begin()+(v.size()-k);
+    std::cout << "Rotate " << name << ": " << (ok ? "OK" : "FAILED")
+              << std::endl;
+    return ok;
+}
+
+struct Large
+{
+    int v[ROTATE_LARGE/sizeof(int)];
+    bool operator==(const Large& o) const
+    {
+        return std::equal(v, v + ROTATE_LARGE/sizeof(int), o.v);
+    }
+};
+
+// Hits every branch of ::rotate's choice (see rotate_algorithm)
+bool check_rotate_branches()
+{
+    std::vector<char> bytes(1000);
+    std::vector<Large> large(1000);
+    std::vector<int> ints(100000);
+    std::vector<std::string> strings(1000);
+    for (size_t i=0; i < bytes.size(); ++i)
+        bytes[i] = i;
+    for (size_t i=0; i < large.size(); ++i)
+        std::fill(large[i].v, large[i].v + ROTATE_LARGE/sizeof(int), i);
+    for (size_t i=0; i < ints.size(); ++i)
+        ints[i] = i;
+    for (size_t i=0; i < strings.size(); ++i)
+        strings[i] = std::string(i % 50, 'a' + i % 26);
+
+    bool ok = check_rotate("bytes", bytes, 377, ROTATE_REVERSAL);
+    ok = check_rotate("large", large, 333, ROTATE_JUGGLING) && ok;
+    ok = check_rotate("buffered", ints, 1000, ROTATE_BUFFERED) && ok;
+    ok = check_rotate("block swap", ints, 40000, ROTATE_BLOCK_SWAP) && ok;
+    ok = check_rotate("strings", strings, 123, ROTATE_BLOCK_SWAP) && ok;
+    return ok;
 }
 
 int main(int argc, char** argv)
 {
+    // Rotate a file in place
+    if (argc > 1)
+    {
+        if (argc < 3)
+        {
+            std::cerr << "Usage: " << argv[0] << " [file count [threads]]"
+                      << std::endl;
+            return 1;
+        }
+        int threads = argc > 3 ? atoi(argv[3]) :
+                                 sysconf(_SC_NPROCESSORS_ONLN);
+        if (!rotate_file(argv[1], atoll(argv[2]), threads))
+        {
+            std::cerr << "Can't rotate " << argv[1] << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
     // Rotate a string using several reverse function
 
     std::string str("01234567");
@@ -93,4 +201,20 @@ int main(int argc, char** argv)
     
     rotate_three(str, 2);
     std::cout << "Rotate_three:" << str << std::endl;
+
+    // ::rotate works on any random access range (see rotate.h)
+    ::rotate(str.begin(), str.begin()+3, str.end());
+    std::cout << "Rotate:" << str << std::endl;
+
+    std::vector<int> v;
+    for (int i=0; i < 8; ++i)
+        v.push_back(i);
+    ::rotate(v.begin(), v.begin()+3, v.end());
+    std::cout << "Rotate vector:";
+    for (size_t i=0; i < v.size(); ++i)
+        std::cout << v[i];
+    std::cout << std::endl;
+
+    if (!check_rotate_branches())
+        return 1;
 }
@@ -0,0 +1,640 @@
+#ifndef __rotate_h_
+#define __rotate_h_
+#include <algorithm>
+#include <cstddef>
+#include <stdint.h>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Rotations of [first, last) that move middle to first, for random access
+// iterators over trivially copyable values (::rotate takes any value, see
+// rotate_algorithm). They return the new position of *first like
+// std::rotate.
+//
+// Use ::rotate with std iterators, argument dependent lookup finds
+// std::rotate as well.
+
+#define ROTATE_BUFFER (64*1024)         // Bytes of buffered_rotate's buffer
+#define ROTATE_CACHE (256*1024)         // Bytes of data that fit in cache
+#define ROTATE_LARGE 32                 // Bytes of a large element
+#define ROTATE_PARALLEL (16*1024*1024)  // Bytes to rotate with threads
+
+template <typename N> N rotate_gcd(N a, N b)
+{
+    while (b)
+    {
+        N t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Reverses [first, last) swapping from both ends
+template <typename It> void reverse_range(It first, It last)
+{
+    while (first < last && first < --last)
+    {
+        std::iter_swap(first, last);
+        ++first;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Reverse bytes with pshufb: loads 32 (16) bytes from each end, reverses
+// them and stores each block at the other end, for *len bytes on each
+// side. Moves *lo, *hi and *len past the blocks done.
+__attribute__((target("avx2")))
+inline void reverse_blocks_avx2(char** lo, char** hi, size_t* len)
+{
+    const __m256i rev = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                         7, 6, 5, 4, 3, 2, 1, 0,
+                                         15, 14, 13, 12, 11, 10, 9, 8,
+                                         7, 6, 5, 4, 3, 2, 1, 0);
+    char* l = *lo;
+    char* h = *hi;
+    for (size_t n=*len/32; n > 0; --n)
+    {
+        h -= 32;
+        __m256i a = _mm256_loadu_si256((const __m256i*)l);
+        __m256i b = _mm256_loadu_si256((const __m256i*)h);
+        // pshufb reverses each 128 bit lane, then swap the lanes
+        a = _mm256_shuffle_epi8(a, rev);
+        b = _mm256_shuffle_epi8(b, rev);
+        a = _mm256_permute2x128_si256(a, a, 1);
+        b = _mm256_permute2x128_si256(b, b, 1);
+        _mm256_storeu_si256((__m256i*)l, b);
+        _mm256_storeu_si256((__m256i*)h, a);
+        l += 32;
+    }
+    *len -= l - *lo;
+    *lo = l;
+    *hi = h;
+}
+
+__attribute__((target("ssse3")))
+inline void reverse_blocks_ssse3(char** lo, char** hi, size_t* len)
+{
+    const __m128i rev = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                      7, 6, 5, 4, 3, 2, 1, 0);
+    char* l = *lo;
+    char* h = *hi;
+    for (size_t n=*len/16; n > 0; --n)
+    {
+        h -= 16;
+        __m128i a = _mm_loadu_si128((const __m128i*)l);
+        __m128i b = _mm_loadu_si128((const __m128i*)h);
+        _mm_storeu_si128((__m128i*)l, _mm_shuffle_epi8(b, rev));
+        _mm_storeu_si128((__m128i*)h, _mm_shuffle_epi8(a, rev));
+        l += 16;
+    }
+    *len -= l - *lo;
+    *lo = l;
+    *hi = h;
+}
+
+// Block steps of reverse_rotate's sweep (see there) over 32 (16) bytes at
+// each pointer, while *len has that many steps left. The blocks read
+// backwards are reversed with pshufb when they move to a block read
+// forwards and vice versa. kind is the cycle: 0 the four element one, 1 the
+// three element one through c (B longer), 2 the one through b (A longer).
+// The three element cycles need the two forward (backward) pointers a block
+// apart. Moves the pointers and *len past the steps done.
+__attribute__((target("avx2")))
+inline __m256i reverse_block_avx2(__m256i v)
+{
+    const __m256i rev = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                         7, 6, 5, 4, 3, 2, 1, 0,
+                                         15, 14, 13, 12, 11, 10, 9, 8,
+                                         7, 6, 5, 4, 3, 2, 1, 0);
+    v = _mm256_shuffle_epi8(v, rev);
+    return _mm256_permute4x64_epi64(v, 0x4e);
+}
+
+__attribute__((target("avx2")))
+inline void rotate_sweep_avx2(char** a, char** b, char** c, char** d,
+                              ptrdiff_t* len, int kind)
+{
+    char* pa = *a;
+    char* pb = *b;
+    char* pc = *c;
+    char* pd = *d;
+    ptrdiff_t n = *len/32;
+    if ((kind == 1 && pc-pa < 32) || (kind == 2 && pd-pb < 32))
+        n = 0;
+    if (kind == 0)
+    {
+        for (; n > 0; --n)
+        {
+            pb -= 32;
+            pd -= 32;
+            __m256i va = _mm256_loadu_si256((const __m256i*)pa);
+            __m256i vb = _mm256_loadu_si256((const __m256i*)pb);
+            __m256i vc = _mm256_loadu_si256((const __m256i*)pc);
+            __m256i vd = _mm256_loadu_si256((const __m256i*)pd);
+            _mm256_storeu_si256((__m256i*)pb, reverse_block_avx2(va));
+            _mm256_storeu_si256((__m256i*)pa, vc);
+            _mm256_storeu_si256((__m256i*)pc, reverse_block_avx2(vd));
+            _mm256_storeu_si256((__m256i*)pd, vb);
+            pa += 32;
+            pc += 32;
+        }
+    }
+    else if (kind == 1)
+    {
+        for (; n > 0; --n)
+        {
+            pd -= 32;
+            __m256i va = _mm256_loadu_si256((const __m256i*)pa);
+            __m256i vc = _mm256_loadu_si256((const __m256i*)pc);
+            __m256i vd = _mm256_loadu_si256((const __m256i*)pd);
+            _mm256_storeu_si256((__m256i*)pd, reverse_block_avx2(va));
+            _mm256_storeu_si256((__m256i*)pa, vc);
+            _mm256_storeu_si256((__m256i*)pc, reverse_block_avx2(vd));
+            pa += 32;
+            pc += 32;
+        }
+    }
+    else
+    {
+        for (; n > 0; --n)
+        {
+            pb -= 32;
+            pd -= 32;
+            __m256i va = _mm256_loadu_si256((const __m256i*)pa);
+            __m256i vb = _mm256_loadu_si256((const __m256i*)pb);
+            __m256i vd = _mm256_loadu_si256((const __m256i*)pd);
+            _mm256_storeu_si256((__m256i*)pb, reverse_block_avx2(va));
+            _mm256_storeu_si256((__m256i*)pa, reverse_block_avx2(vd));
+            _mm256_storeu_si256((__m256i*)pd, vb);
+            pa += 32;
+        }
+    }
+    *len -= pa - *a;
+    *a = pa;
+    *b = pb;
+    *c = pc;
+    *d = pd;
+}
+
+__attribute__((target("ssse3")))
+inline void rotate_sweep_ssse3(char** a, char** b, char** c, char** d,
+                               ptrdiff_t* len, int kind)
+{
+    const __m128i rev = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                      7, 6, 5, 4, 3, 2, 1, 0);
+    char* pa = *a;
+    char* pb = *b;
+    char* pc = *c;
+    char* pd = *d;
+    ptrdiff_t n = *len/16;
+    if ((kind == 1 && pc-pa < 16) || (kind == 2 && pd-pb < 16))
+        n = 0;
+    if (kind == 0)
+    {
+        for (; n > 0; --n)
+        {
+            pb -= 16;
+            pd -= 16;
+            __m128i va = _mm_loadu_si128((const __m128i*)pa);
+            __m128i vb = _mm_loadu_si128((const __m128i*)pb);
+            __m128i vc = _mm_loadu_si128((const __m128i*)pc);
+            __m128i vd = _mm_loadu_si128((const __m128i*)pd);
+            _mm_storeu_si128((__m128i*)pb, _mm_shuffle_epi8(va, rev));
+            _mm_storeu_si128((__m128i*)pa, vc);
+            _mm_storeu_si128((__m128i*)pc, _mm_shuffle_epi8(vd, rev));
+            _mm_storeu_si128((__m128i*)pd, vb);
+            pa += 16;
+            pc += 16;
+        }
+    }
+    else if (kind == 1)
+    {
+        for (; n > 0; --n)
+        {
+            pd -= 16;
+            __m128i va = _mm_loadu_si128((const __m128i*)pa);
+            __m128i vc = _mm_loadu_si128((const __m128i*)pc);
+            __m128i vd = _mm_loadu_si128((const __m128i*)pd);
+            _mm_storeu_si128((__m128i*)pd, _mm_shuffle_epi8(va, rev));
+            _mm_storeu_si128((__m128i*)pa, vc);
+            _mm_storeu_si128((__m128i*)pc, _mm_shuffle_epi8(vd, rev));
+            pa += 16;
+            pc += 16;
+        }
+    }
+    else
+    {
+        for (; n > 0; --n)
+        {
+            pb -= 16;
+            pd -= 16;
+            __m128i va = _mm_loadu_si128((const __m128i*)pa);
+            __m128i vb = _mm_loadu_si128((const __m128i*)pb);
+            __m128i vd = _mm_loadu_si128((const __m128i*)pd);
+            _mm_storeu_si128((__m128i*)pb, _mm_shuffle_epi8(va, rev));
+            _mm_storeu_si128((__m128i*)pa, _mm_shuffle_epi8(vd, rev));
+            _mm_storeu_si128((__m128i*)pd, vb);
+            pa += 16;
+        }
+    }
+    *len -= pa - *a;
+    *a = pa;
+    *b = pb;
+    *c = pc;
+    *d = pd;
+}
+#endif
+
+// Swaps lo[i] with hi[-1-i] for i in [0, len): with len half of hi-lo it
+// reverses [lo, hi), with less it does a mirrored pair of segments of that
+// reversal, independent from the others. 32 or 16 bytes at a time where
+// the CPU supports it, then one at a time.
+inline void reverse_pairs(char* lo, char* hi, size_t len)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    static const int isa = __builtin_cpu_supports("avx2") ? 2 :
+                           __builtin_cpu_supports("ssse3") ? 1 : 0;
+    if (isa >= 2)
+        reverse_blocks_avx2(&lo, &hi, &len);
+    if (isa >= 1)
+        reverse_blocks_ssse3(&lo, &hi, &len);
+#endif
+    for (; len > 0; --len)
+    {
+        char t = *lo;
+        *lo++ = *--hi;
+        *hi = t;
+    }
+}
+
+// Reverses the bytes in [first, last)
+inline void reverse_bytes(char* first, char* last)
+{
+    if (first < last)
+        reverse_pairs(first, last, (last-first)/2);
+}
+
+inline void reverse_range(char* first, char* last)
+{
+    reverse_bytes(first, last);
+}
+
+inline void reverse_range(unsigned char* first, unsigned char* last)
+{
+    reverse_bytes((char*)first, (char*)last);
+}
+
+// Block steps of reverse_rotate: none for generic iterators, SIMD ones
+// for bytes (see rotate_sweep_avx2).
+template <typename It, typename D> void rotate_sweep(It*, It*, It*, It*, D*,
+                                                     int)
+{
+}
+
+inline void rotate_sweep(char** a, char** b, char** c, char** d,
+                         ptrdiff_t* len, int kind)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    static const int isa = __builtin_cpu_supports("avx2") ? 2 :
+                           __builtin_cpu_supports("ssse3") ? 1 : 0;
+    if (isa >= 2)
+        rotate_sweep_avx2(a, b, c, d, len, kind);
+    if (isa >= 1)
+        rotate_sweep_ssse3(a, b, c, d, len, kind);
+#else
+    (void)a; (void)b; (void)c; (void)d; (void)len; (void)kind;
+#endif
+}
+
+// Triple reversal in a single sweep: the reversals of A, of B and of the
+// whole range advance together from both ends, so each step swaps the
+// mirrored positions of A, of B and of the whole range at once. While both
+// parts have pairs left it's a cycle of four elements, then three while the
+// longer part finishes, then a plain reversal of what is left in between.
+// Bytes go through rotate_sweep's pshufb blocks first.
+template <typename It> It reverse_rotate(It first, It middle, It last)
+{
+    typedef typename std::iterator_traits<It>::value_type T;
+    typedef typename std::iterator_traits<It>::difference_type D;
+    const It result = first + (last - middle);
+    if (first == middle || middle == last)
+        return result;
+    It a = first;   // Start of A, end of the whole range: final places
+    It b = middle;  // End of A and start of B: reversed parts
+    It c = middle;
+    It d = last;
+    D n = std::min(middle-first, last-middle)/2;
+    rotate_sweep(&a, &b, &c, &d, &n, 0);
+    for (; n > 0; --n)
+    {
+        T t = *--b;
+        *b = *a;
+        *a++ = *c;
+        *c++ = *--d;
+        *d = t;
+    }
+    if (d - c > b - a)
+    {
+        n = (d-c)/2;
+        rotate_sweep(&a, &b, &c, &d, &n, 1);
+        for (; n > 0; --n)
+        {
+            T t = *--d;
+            *d = *a;
+            *a++ = *c;
+            *c++ = t;
+        }
+    }
+    else
+    {
+        n = (b-a)/2;
+        rotate_sweep(&a, &b, &c, &d, &n, 2);
+        for (; n > 0; --n)
+        {
+            T t = *--b;
+            *b = *a;
+            *a++ = *--d;
+            *d = t;
+        }
+    }
+    reverse_range(a, d);
+    return result;
+}
+
+inline unsigned char* reverse_rotate(unsigned char* first,
+                                     unsigned char* middle,
+                                     unsigned char* last)
+{
+    return (unsigned char*)reverse_rotate((char*)first, (char*)middle,
+                                          (char*)last);
+}
+
+// Triple reversal: reverse both parts, then the whole range, each with
+// reverse_range (SIMD for bytes).
+template <typename It> It reversal_rotate(It first, It middle, It last)
+{
+    reverse_range(first, middle);
+    reverse_range(middle, last);
+    reverse_range(first, last);
+    return first + (last - middle);
+}
+
+// Juggling: follows the gcd(n, k) cycles of the permutation, moving every
+// element once through a single temporary. The fewest moves, but each one
+// jumps k elements away: good for data in cache and large elements.
+template <typename It> It juggling_rotate(It first, It middle, It last)
+{
+    typedef typename std::iterator_traits<It>::value_type T;
+    typedef typename std::iterator_traits<It>::difference_type D;
+    const D n = last - first;
+    const D k = middle - first;
+    if (k == 0 || k == n)
+        return first + (n - k);
+    const D cycles = rotate_gcd(n, k);
+    for (D i=0; i < cycles; ++i)
+    {
+        T t = first[i];
+        D j = i;
+        while (true)
+        {
+            D next = j + k;
+            if (next >= n)
+                next -= n;
+            if (next == i)
+                break;
+            first[j] = first[next];
+            j = next;
+        }
+        first[j] = t;
+    }
+    return first + (n - k);
+}
+
+// Block swap (Gries and Mills): swaps the shorter part with the end of the
+// longer one, which puts it in place, and goes on with the rest. Works
+// while the shorter part is longer than stop, then returns the part left
+// to rotate in [*first, *last) around *middle.
+template <typename It> void block_swap_reduce(It* first, It* middle,
+                                              It* last,
+                                              typename std::iterator_traits<
+                                                  It>::difference_type stop)
+{
+    typedef typename std::iterator_traits<It>::difference_type D;
+    D i = *middle - *first;
+    D j = *last - *middle;
+    It p = *middle;
+    while (i != j && std::min(i, j) > stop)
+    {
+        if (i > j)
+        {
+            std::swap_ranges(p-i, p-i+j, p);
+            i -= j;
+        }
+        else
+        {
+            std::swap_ranges(p-i, p, p+j-i);
+            j -= i;
+        }
+    }
+    if (i == j)
+    {
+        std::swap_ranges(p-i, p, p);
+        i = j = 0;
+    }
+    *first = p-i;
+    *middle = p;
+    *last = p+j;
+}
+
+template <typename It> It block_swap_rotate(It first, It middle, It last)
+{
+    It result = first + (last - middle);
+    block_swap_reduce(&first, &middle, &last, 0);
+    return result;
+}
+
+// Copies the shorter part in a stack buffer of at most buffer_bytes (and
+// ROTATE_BUFFER), moves the other one and copies the buffer back:
+// n+min(k, n-k) sequential moves and no allocation. If the shorter part
+// doesn't fit, block swaps shrink it first.
+template <typename It> It buffered_rotate(It first, It middle, It last,
+                                          size_t buffer_bytes=ROTATE_BUFFER)
+{
+    typedef typename std::iterator_traits<It>::value_type T;
+    typedef typename std::iterator_traits<It>::difference_type D;
+    It result = first + (last - middle);
+    buffer_bytes = std::min(buffer_bytes, size_t(ROTATE_BUFFER));
+    if (buffer_bytes < sizeof(T))
+        return block_swap_rotate(first, middle, last);
+    block_swap_reduce(&first, &middle, &last, D(buffer_bytes/sizeof(T)));
+    const D k = middle - first;
+    const D rest = last - middle;
+    if (k == 0 || rest == 0)
+        return result;
+    __attribute__((aligned(64))) char storage[ROTATE_BUFFER];
+    T* buf = (T*)storage;
+    if (k <= rest)
+    {
+        std::copy(first, middle, buf);
+        std::copy(middle, last, first);
+        std::copy(buf, buf + k, last - k);
+    }
+    else
+    {
+        std::copy(middle, last, buf);
+        std::copy_backward(first, middle, last);
+        std::copy(buf, buf + rest, first);
+    }
+    return result;
+}
+
+enum RotateAlgorithm
+{
+    ROTATE_REVERSAL,
+    ROTATE_JUGGLING,
+    ROTATE_BUFFERED,
+    ROTATE_BLOCK_SWAP
+};
+
+// Picks the rotation of n elements of type T around k (0 < k < n) from
+// the element type and the sizes in bytes of the shorter part and of the
+// whole range:
+//  - bytes: reversal_rotate, whose reversals run with pshufb on char
+//    ranges;
+//  - elements of ROTATE_LARGE bytes or more in a range that fits in
+//    ROTATE_CACHE: juggling_rotate, which moves each of them only once,
+//    where its jumps are cheap;
+//  - a shorter part that fits in ROTATE_BUFFER: buffered_rotate, with just
+//    two copies through the stack;
+//  - larger parts and values that aren't trivially copyable:
+//    block_swap_rotate, which only swaps and streams through memory.
+template <typename T> RotateAlgorithm rotate_algorithm(size_t n, size_t k)
+{
+    if (!__is_trivially_copyable(T))
+        return ROTATE_BLOCK_SWAP;
+    if (sizeof(T) == 1)
+        return ROTATE_REVERSAL;
+    if (sizeof(T) >= ROTATE_LARGE && n*sizeof(T) <= ROTATE_CACHE)
+        return ROTATE_JUGGLING;
+    if (std::min(k, n-k)*sizeof(T) <= ROTATE_BUFFER)
+        return ROTATE_BUFFERED;
+    return ROTATE_BLOCK_SWAP;
+}
+
+template <typename It> It rotate(It first, It middle, It last)
+{
+    typedef typename std::iterator_traits<It>::value_type T;
+    const size_t n = last - first;
+    const size_t k = middle - first;
+    if (k == 0 || k == n)
+        return first + (n - k);
+    switch (rotate_algorithm<T>(n, k))
+    {
+        case ROTATE_REVERSAL:
+            return reversal_rotate(first, middle, last);
+        case ROTATE_JUGGLING:
+            return juggling_rotate(first, middle, last);
+        case ROTATE_BUFFERED:
+            return buffered_rotate(first, middle, last);
+        default:
+            return block_swap_rotate(first, middle, last);
+    }
+}
+
+// Bytes: past the buffer the SIMD triple reversal (see reverse_bytes) is
+// faster than the block swaps
+inline char* rotate(char* first, char* middle, char* last)
+{
+    const size_t n = last - first;
+    const size_t k = middle - first;
+    if (std::min(k, n-k) <= ROTATE_BUFFER)
+        return buffered_rotate(first, middle, last);
+    return reversal_rotate(first, middle, last);
+}
+
+inline unsigned char* rotate(unsigned char* first, unsigned char* middle,
+                             unsigned char* last)
+{
+    return (unsigned char*)::rotate((char*)first, (char*)middle, (char*)last);
+}
+
+// Mirrored pair of segments of a reversal (see reverse_pairs)
+struct ReverseSegment
+{
+    char* lo;
+    char* hi;
+    size_t len;
+};
+
+inline void* reverse_segments(void* arg)
+{
+    std::vector<ReverseSegment>* segments = (std::vector<ReverseSegment>*)arg;
+    for (size_t s=0; s < segments->size(); ++s)
+    {
+        const ReverseSegment& segment = (*segments)[s];
+        reverse_pairs(segment.lo, segment.hi, segment.len);
+    }
+    return NULL;
+}
+
+// Reverses all the byte ranges of ranges at once with threads threads:
+// each reversal is split in threads mirrored pairs of segments that can be
+// swapped in any order. The segments of the first half start on cache line
+// addresses, so no two threads write the same line there; their mirrors
+// share a line at each boundary unless first+last is line aligned too.
+inline void parallel_reverse(
+    const std::vector<std::pair<char*, char*> >& ranges, int threads)
+{
+    std::vector<std::vector<ReverseSegment> > work(threads);
+    for (size_t r=0; r < ranges.size(); ++r)
+    {
+        char* first = ranges[r].first;
+        char* last = ranges[r].second;
+        const size_t half = (last - first)/2;
+        const size_t step = (half + threads-1)/threads;
+        size_t a = 0;
+        for (int t=0; t < threads && a < half; ++t)
+        {
+            // Next boundary: the cache line after first+(t+1)*step
+            uintptr_t line = (uintptr_t(first + (t+1)*step) + 63) &
+                             ~uintptr_t(63);
+            size_t b = std::min(size_t(line - uintptr_t(first)), half);
+            ReverseSegment segment = { first+a, last-a, b-a };
+            work[t].push_back(segment);
+            a = b;
+        }
+    }
+    std::vector<pthread_t> thds(threads);
+    for (int t=0; t < threads; ++t)
+        pthread_create(&thds[t], NULL, reverse_segments, &work[t]);
+    for (int t=0; t < threads; ++t)
+        pthread_join(thds[t], NULL);
+}
+
+// Rotates bytes with threads threads, without extra memory: the triple
+// reversal, reversing both parts at once and then the whole range, each
+// reversal split among the threads. Ranges shorter than ROTATE_PARALLEL
+// go to rotate.
+inline char* parallel_rotate(char* first, char* middle, char* last,
+                             int threads)
+{
+    if (threads <= 1 || size_t(last - first) < ROTATE_PARALLEL ||
+        first == middle || middle == last)
+        return ::rotate(first, middle, last);
+    std::vector<std::pair<char*, char*> > ranges;
+    ranges.push_back(std::make_pair(first, middle));
+    ranges.push_back(std::make_pair(middle, last));
+    parallel_reverse(ranges, threads);
+    ranges.clear();
+    ranges.push_back(std::make_pair(first, last));
+    parallel_reverse(ranges, threads);
+    return first + (last - middle);
+}
+
+#endif
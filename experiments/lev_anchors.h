@@ -0,0 +1,221 @@
+// Copyright 2012 - Stefano Brilli : stefanobrilli@gmail.com
+//
+// Preprocessing for file pairs that are mostly identical.
+//
+// The common prefix and suffix don't change the distance, so they are
+// trimmed first, comparing 8 bytes at a time. The rest is then split on
+// long exact matches (anchors): file1 is indexed in blocks by a rolling hash
+// (as rsync does) and file2 is scanned for them; every hit is checked byte by
+// byte and extended in both directions. Only the regions between anchors go
+// through the DP.
+//
+// Trimming is exact. Forcing the alignment through anchors is not: the sum of
+// the distances of the regions is an upper bound, exact only when it meets
+// the lower bound |m-n| or no anchor was used.
+
+#ifndef _LEV_ANCHORS_H_
+#define _LEV_ANCHORS_H_
+
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+#include "lev_distance.h"
+
+// Hits in file1 checked for every position of file2
+#define ANCHOR_MAX_CHAIN 16
+
+// Length of the common prefix of a and b (size bytes at most)
+inline int64_t CommonPrefix(const char* a, const char* b, int64_t size) {
+    int64_t i = 0;
+    for (; i+8 <= size; i += 8) {
+        uint64_t wa, wb;
+        memcpy(&wa, a+i, 8);
+        memcpy(&wb, b+i, 8);
+        if (wa != wb) { // Little endian: the first byte is the lowest one
+            return i + __builtin_ctzll(wa ^ wb)/8;
+        }
+    }
+    while (i < size && a[i] == b[i]) {
+        ++i;
+    }
+    return i;
+}
+
+// Length of the common suffix of a and b, that both end at a_end and b_end
+// (size bytes at most)
+inline int64_t CommonSuffix(const char* a_end, const char* b_end,
+                            int64_t size) {
+    int64_t i = 0;
+    for (; i+8 <= size; i += 8) {
+        uint64_t wa, wb;
+        memcpy(&wa, a_end-i-8, 8);
+        memcpy(&wb, b_end-i-8, 8);
+        if (wa != wb) { // Little endian: the last byte is the highest one
+            return i + __builtin_clzll(wa ^ wb)/8;
+        }
+    }
+    while (i < size && a_end[-i-1] == b_end[-i-1]) {
+        ++i;
+    }
+    return i;
+}
+
+struct Anchor
+{
+    Anchor(int64_t pos1, int64_t pos2, int64_t size) :
+        pos1(pos1), pos2(pos2), size(size) {}
+    int64_t pos1;
+    int64_t pos2;
+    int64_t size;
+};
+
+// Polynomial rolling hash of a window of size bytes
+class RollingHash
+{
+public:
+    explicit RollingHash(int64_t size) : hash(0), out_factor(1) {
+        for (int64_t i=1; i < size; ++i) {
+            out_factor *= BASE;
+        }
+    }
+
+    uint64_t Init(const char* data, int64_t size) {
+        hash = 0;
+        for (int64_t i=0; i < size; ++i) {
+            hash = hash*BASE + (unsigned char)data[i];
+        }
+        return hash;
+    }
+
+    uint64_t Roll(char out, char in) {
+        hash = (hash - (unsigned char)out*out_factor)*BASE + (unsigned char)in;
+        return hash;
+    }
+
+private:
+    static const uint64_t BASE = 1099511628211ULL;
+    uint64_t hash;
+    uint64_t out_factor;
+};
+
+// Fills anchors with exact matches of at least min_size bytes between a and
+// b, increasing and not overlapping in both inputs. Greedy: the first match
+// found scanning b is taken.
+inline void FindAnchors(const char* a, int64_t m, const char* b, int64_t n,
+                        int64_t min_size, std::vector<Anchor>* anchors) {
+    anchors->clear();
+    // A match of 2*block-1 bytes always covers a whole block of a
+    const int64_t block = std::max(int64_t(1), (min_size+1)/2);
+    const int64_t blocks = m/block;
+    if (blocks == 0 || n < block) {
+        return;
+    }
+
+    // Hash chains, as in zlib: head of each bucket, then previous block
+    size_t buckets = 1;
+    while (buckets < size_t(2*blocks)) {
+        buckets <<= 1;
+    }
+    const size_t mask = buckets-1;
+    std::vector<int64_t> head(buckets, -1);
+    std::vector<int64_t> chain(blocks, -1);
+    std::vector<uint64_t> block_hash(blocks);
+    RollingHash rolling(block);
+    for (int64_t k=0; k < blocks; ++k) {
+        block_hash[k] = rolling.Init(a+k*block, block);
+        chain[k] = head[block_hash[k] & mask];
+        head[block_hash[k] & mask] = k;
+    }
+
+    int64_t a_done = 0; // End of the last anchor in a
+    int64_t b_done = 0; // End of the last anchor in b
+    int64_t j = 0;
+    uint64_t hash = rolling.Init(b, block);
+    while (true) {
+        bool found = false;
+        int64_t visited = 0;
+        for (int64_t k=head[hash & mask]; k >= 0 && !found &&
+             visited < ANCHOR_MAX_CHAIN; k=chain[k], ++visited) {
+            int64_t pos1 = k*block;
+            if (block_hash[k] != hash || pos1 < a_done ||
+                memcmp(a+pos1, b+j, block) != 0) {
+                continue;
+            }
+            int64_t pos2 = j;
+            int64_t back = 0;
+            while (pos1-back > a_done && pos2-back > b_done &&
+                   a[pos1-back-1] == b[pos2-back-1]) {
+                ++back;
+            }
+            int64_t size = block + CommonPrefix(a+pos1+block, b+pos2+block,
+                std::min(m-pos1-block, n-pos2-block));
+            pos1 -= back;
+            pos2 -= back;
+            size += back;
+            if (size >= min_size) {
+                anchors->push_back(Anchor(pos1, pos2, size));
+                a_done = pos1+size;
+                b_done = pos2+size;
+                found = true;
+            }
+        }
+
+        if (found) {
+            j = b_done;
+            if (j+block > n) {
+                break;
+            }
+            hash = rolling.Init(b+j, block);
+        } else {
+            if (j+block >= n) {
+                break;
+            }
+            hash = rolling.Roll(b[j], b[j+block]);
+            ++j;
+        }
+    }
+}
+
+// Returns the Levenshtein distance to change file1_data into file2_data,
+// after trimming the common prefix and suffix and, if min_anchor > 0,
+// splitting on anchors of at least min_anchor bytes. The regions left are
+// measured with BitParallelLevDistance.
+//
+// exact is set to false when the result is only an upper bound.
+inline int64_t AnchoredLevDistance(char* file1_data, int64_t file1_size,
+                                   char* file2_data, int64_t file2_size,
+                                   int64_t min_anchor, bool* exact) {
+    int64_t prefix = CommonPrefix(file1_data, file2_data,
+                                  std::min(file1_size, file2_size));
+    char* a = file1_data+prefix;
+    char* b = file2_data+prefix;
+    int64_t m = file1_size-prefix;
+    int64_t n = file2_size-prefix;
+    int64_t suffix = CommonSuffix(a+m, b+n, std::min(m, n));
+    m -= suffix;
+    n -= suffix;
+
+    std::vector<Anchor> anchors;
+    if (min_anchor > 0) {
+        FindAnchors(a, m, b, n, min_anchor, &anchors);
+    }
+    // The end of the inputs closes the last region
+    anchors.push_back(Anchor(m, n, 0));
+
+    int64_t distance = 0;
+    int64_t a_done = 0;
+    int64_t b_done = 0;
+    for (size_t k=0; k < anchors.size(); ++k) {
+        distance += BitParallelLevDistance(a+a_done, anchors[k].pos1-a_done,
+                                           b+b_done, anchors[k].pos2-b_done);
+        a_done = anchors[k].pos1+anchors[k].size;
+        b_done = anchors[k].pos2+anchors[k].size;
+    }
+
+    *exact = anchors.size() == 1 ||
+        distance == std::max(m, n)-std::min(m, n);
+    return distance;
+}
+
+#endif
@@ -0,0 +1,213 @@
+// Copyright 2012 - Stefano Brilli : stefanobrilli@gmail.com
+//
+// One-against-many Levenshtein search: finds the top_n candidates closest to
+// a query file.
+//
+// The candidates are shared among a pool of threads through an atomic
+// counter; every thread keeps its own DP rows for all its comparisons. Once
+// top_n candidates have been found, the distance of the worst of them bounds
+// the next comparisons (LevDistanceBounded), so candidates that can't make
+// it into the top are dropped after a few rows. Until the bound is below the
+// size of the inputs, comparisons use BitParallelLevDistance instead.
+// Candidates are visited by increasing size difference from the query, that
+// is a lower bound of the distance, so the bound tightens early.
+
+#ifndef _LEV_BATCH_H_
+#define _LEV_BATCH_H_
+
+#include <cstdio>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "lev_distance.h"
+#include "thread.h"
+
+struct LevMatch
+{
+    LevMatch(int64_t distance, size_t candidate) :
+        distance(distance), candidate(candidate) {}
+    int64_t distance;
+    size_t candidate; // Index in the list of candidates
+};
+
+inline bool operator<(const LevMatch& a, const LevMatch& b) {
+    return a.distance < b.distance ||
+        (a.distance == b.distance && a.candidate < b.candidate);
+}
+
+// Appends to candidates the regular files inside path if it is a directory,
+// otherwise the lines of path (one file name per line).
+// Returns false if path can't be read.
+inline bool ListCandidates(const char* path,
+                           std::vector<std::string>* candidates) {
+    DIR* dir = opendir(path);
+    if (dir != NULL) {
+        std::vector<std::string> names;
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            std::string name = std::string(path)+"/"+entry->d_name;
+            struct stat st;
+            if (stat(name.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+                names.push_back(name);
+            }
+        }
+        closedir(dir);
+        std::sort(names.begin(), names.end());
+        candidates->insert(candidates->end(), names.begin(), names.end());
+        return true;
+    }
+
+    FILE* list = fopen(path, "r");
+    if (list == NULL) {
+        return false;
+    }
+    char line[4096];
+    while (fgets(line, sizeof(line), list) != NULL) {
+        std::string name(line);
+        while (!name.empty() &&
+               (name[name.size()-1] == '\n' || name[name.size()-1] == '\r')) {
+            name.erase(name.size()-1);
+        }
+        if (!name.empty()) {
+            candidates->push_back(name);
+        }
+    }
+    fclose(list);
+    return true;
+}
+
+class LevBatch
+{
+public:
+    LevBatch(char* query, int64_t query_size,
+             const std::vector<std::string>& candidates, size_t top_n,
+             int threads) :
+        query(query), query_size(query_size), candidates(candidates),
+        top_n(top_n), threads(threads), next(0) {
+        pthread_mutex_init(&lock, NULL);
+    }
+
+    ~LevBatch() {
+        pthread_mutex_destroy(&lock);
+    }
+
+    // Fills best with the top_n closest candidates, closest first
+    void Run(std::vector<LevMatch>* best) {
+        std::vector<LevMatch> by_size;
+        for (size_t c=0; c < candidates.size(); ++c) {
+            struct stat st;
+            int64_t gap = stat(candidates[c].c_str(), &st) == 0 ?
+                std::max(int64_t(st.st_size), query_size)-
+                std::min(int64_t(st.st_size), query_size) : 0;
+            by_size.push_back(LevMatch(gap, c));
+        }
+        std::sort(by_size.begin(), by_size.end());
+        order.clear();
+        for (size_t k=0; k < by_size.size(); ++k) {
+            order.push_back(by_size[k].candidate);
+        }
+
+        top.clear();
+        next = 0;
+        std::vector< Result<int> > workers;
+        for (int t=1; t < threads; ++t) {
+            workers.push_back(Thread::run(this, &LevBatch::Worker, t));
+        }
+        Worker(0);
+        for (size_t t=0; t < workers.size(); ++t) {
+            workers[t].value();
+        }
+        *best = top;
+    }
+
+private:
+    int Worker(int) {
+        // DP rows reused by all the comparisons of this thread
+        std::vector<int64_t> current;
+        std::vector<int64_t> previous;
+        size_t k;
+        while ((k = __sync_fetch_and_add(&next, 1)) < order.size()) {
+            const size_t c = order[k];
+            char* data = NULL;
+            int64_t size = LoadFile(candidates[c].c_str(), &data);
+            if (size < 0) {
+                fprintf(stderr, "Can't load file: %s\n",
+                        candidates[c].c_str());
+                continue;
+            }
+
+            // The distance never exceeds the longer input: a bound that
+            // large prunes nothing, and the bit-parallel engine is faster
+            // than the band.
+            int64_t bound = Bound();
+            if (bound >= std::max(query_size, size)) {
+                Offer(LevMatch(BitParallelLevDistance(query, query_size,
+                                                      data, size), c));
+            } else if (bound >= 0) {
+                int64_t d = LevDistanceBounded(query, query_size, data, size,
+                                               bound, &current, &previous);
+                if (d <= bound) {
+                    Offer(LevMatch(d, c));
+                }
+            }
+            UnloadFile(data, size);
+        }
+        return 0;
+    }
+
+    // Largest distance that can still enter the top (on ties, the candidate
+    // listed first wins, so the result doesn't depend on the threads)
+    int64_t Bound() {
+        pthread_mutex_lock(&lock);
+        int64_t bound = top.size() < top_n ? INT64_MAX : top.back().distance;
+        pthread_mutex_unlock(&lock);
+        return bound;
+    }
+
+    void Offer(const LevMatch& match) {
+        pthread_mutex_lock(&lock);
+        if (top.size() < top_n) {
+            top.push_back(match);
+        } else if (match < top.back()) {
+            top.back() = match;
+        }
+        std::sort(top.begin(), top.end());
+        pthread_mutex_unlock(&lock);
+    }
+
+    char* query;
+    const int64_t query_size;
+    const std::vector<std::string>& candidates;
+    const size_t top_n;
+    const int threads;
+    std::vector<size_t> order;
+    std::vector<LevMatch> top;
+    volatile size_t next;
+    pthread_mutex_t lock;
+
+    LevBatch(const LevBatch&);
+    LevBatch& operator=(const LevBatch&);
+};
+
+// Fills best with the top_n candidates closest to query, closest first,
+// using threads threads (or one per online CPU if threads <= 0).
+inline void LevBatchSearch(char* query, int64_t query_size,
+                           const std::vector<std::string>& candidates,
+                           size_t top_n, std::vector<LevMatch>* best,
+                           int threads=0) {
+    if (threads <= 0) {
+        threads = std::max(1, int(sysconf(_SC_NPROCESSORS_ONLN)));
+    }
+    best->clear();
+    if (top_n == 0) {
+        return;
+    }
+    LevBatch(query, query_size, candidates, top_n, threads).Run(best);
+}
+
+#endif
@@ -18,8 +18,10 @@
 
 #include <cstdlib>
 #include <cstdio>
+#include <climits>
 #include <algorithm>
 #include <vector>
+#include "lev_distance.h"
 
 // Threads per block: since this is just an exercise, we use a fixed
 // TPB size. In a real case the best configuration should be searched
@@ -32,52 +34,6 @@
 #define CUDA_CHECK(function_call) if (function_call != cudaSuccess) \
 { fprintf(stderr, "ERR: %s\n", #function_call); exit(1); }
 
-// Opens a file_name, allocates a buffer big as the content of the entire file
-// and finally put the file content into the buffer.
-//
-// Returns the file size
-// The ownership of the buffer is passed to the caller function.
-// YOU MUST CALL free() ON RETURNED BUFFER
-//
-// No NULLs are not allowed as input
-int LoadFileOrDie(const char* file_name, char** file_content) {
-    FILE* fd;
-    int size = 0;
-    bool fail = (fd=fopen(file_name, "rb")) == NULL ||
-        fseek(fd, 0, SEEK_END) < 0 ||
-        (size = ftell(fd)) < 0 ||
-        (*file_content=(char*)malloc(size)) == NULL ||
-        fseek(fd, 0, SEEK_SET) != 0 ||
-        int(fread(*file_content, 1, size, fd)) != size ||
-        fclose(fd) == -1;
-    if (fail) {
-        fprintf(stderr, "Can't load file: %s\n", file_name);
-        exit(1);
-    }
-    return size;
-}
-
-// Returns the Levenshtein distance to change file1_data into file2_data.
-int LevDistance(char* file1_data, int file1_size,
-             char* file2_data, int file2_size) {
-    int sz = file2_size+1;
-    std::vector<int> current(sz);
-    std::vector<int> previous(sz);
-    for (int i=0; i < sz; ++i) {
-        previous[i] = i;
-    }
-
-    for (int i=0; i < file1_size; ++i) {
-        current[0] = i+1;
-        for (int j=1 ; j < sz; ++j) {
-            current[j] = std::min( std::min(previous[j], current[j-1])+1, 
-                previous[j-1]+(file1_data[i] != file2_data[j-1] ? 1 : 0));
-        }
-        std::swap(current, previous);
-    }
-    return previous[sz-1];
-}
-
 // Handles diagonals from 1 to m+1
 __global__ void stage0(char* file1_data, char* file2_data, int iteration, 
                         int* curr, int* prev, int* prev2) {
@@ -214,13 +170,19 @@ int main(int argc, char** argv) {
     }
 
     char* file1 = NULL;
-    int file1_size = LoadFileOrDie(argv[1], &file1);
+    int64_t file1_size = LoadFileOrDie(argv[1], &file1);
 
     char* file2 = NULL;
-    int file2_size = LoadFileOrDie(argv[2], &file2);
+    int64_t file2_size = LoadFileOrDie(argv[2], &file2);
+
+    printf("%s size is %lld bytes\n", argv[1], (long long)file1_size);
+    printf("%s size is %lld bytes\n", argv[2], (long long)file2_size);
 
-    printf("%s size is %d bytes\n", argv[1], file1_size);
-    printf("%s size is %d bytes\n", argv[2], file2_size);
+    // The GPU kernels index the inputs with int
+    if (std::max(file1_size, file2_size) > INT_MAX) {
+        fprintf(stderr, "Files over 2GB are supported by lev_distance_cpu only\n");
+        exit(1);
+    }
 
     if (file1_size > file2_size) {
         std::swap(file1_size, file2_size);
@@ -229,12 +191,24 @@ int main(int argc, char** argv) {
 
     clock_t timer = clock();
     printf("LevDistance...\n");
-    int ld = LevDistance(file1, file1_size, file2, file2_size);
+    int64_t ld = LevDistance(file1, file1_size, file2, file2_size);
     printf("elapsed time: %.3f (s)\n", double(clock()-timer)/CLOCKS_PER_SEC);
 
+    timer = clock();
+    printf("BitParallelLevDistance...\n");
+    int64_t bld = BitParallelLevDistance(file1, file1_size, file2, file2_size);
+    printf("elapsed time: %.3f (s)\n", double(clock()-timer)/CLOCKS_PER_SEC);
+
+    if (ld != bld) {
+        fprintf(stderr, "CRITICAL: LevDistance result differs from BitParallelLevDistance!");
+        exit(1);
+    } else {
+        printf("OK: Reference-BitParallel Result matches!\n");
+    }
+
     timer = clock();
     printf("CudaLevDistance...\n");
-    int cld = CudaLevDistance(file1, file1_size, file2, file2_size);
+    int cld = CudaLevDistance(file1, int(file1_size), file2, int(file2_size));
     printf("elapsed time: %.3f (s)\n", double(clock()-timer)/CLOCKS_PER_SEC);
 
     if (ld != cld) {
@@ -247,8 +221,8 @@ int main(int argc, char** argv) {
     printf("Distance: %d\n", cld);
 
     // No need to free memory since the program ends
-    free(file1);
-    free(file2);
+    UnloadFile(file1, file1_size);
+    UnloadFile(file2, file2_size);
 
     return 0;
 }
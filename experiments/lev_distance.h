@@ -0,0 +1,467 @@
+// Copyright 2012 - Stefano Brilli : stefanobrilli@gmail.com
+//
+// CPU engines for the Levenshtein distance between 2 files.
+// Shared by lev_distance (CUDA) and lev_distance_cpu.
+//
+
+#ifndef _LEV_DISTANCE_H_
+#define _LEV_DISTANCE_H_
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "thread.h"
+
+// Reads fd to the end into an anonymous read only mapping, for inputs that
+// can't be mapped (pipes, FIFOs, /dev/fd/N), so that UnloadFile() releases
+// it like a mapped file.
+//
+// Returns the number of bytes read, or -1 on errors.
+inline int64_t ReadFile(int fd, char** file_content) {
+    std::vector<char> data;
+    char buffer[1 << 16];
+    for (;;) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        data.insert(data.end(), buffer, buffer+n);
+    }
+    if (data.empty()) {
+        return 0;
+    }
+    void* map = mmap(NULL, data.size(), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    memcpy(map, &data[0], data.size());
+    mprotect(map, data.size(), PROT_READ);
+    *file_content = (char*)map;
+    return data.size();
+}
+
+// Maps file_name in memory, read only, and tells the kernel that it will be
+// read sequentially. Nothing is copied: pages are loaded on demand and can be
+// dropped under memory pressure, so inputs can be larger than the RAM.
+// Anything but a regular file is read with ReadFile() instead, since its
+// st_size says nothing about the content.
+//
+// Returns the file size (64 bit, files over 2GB are fine), or -1 on errors.
+// The mapping is passed to the caller function, the content is read only.
+// YOU MUST CALL UnloadFile() ON RETURNED BUFFER
+//
+// No NULLs are not allowed as input
+inline int64_t LoadFile(const char* file_name, char** file_content) {
+    int fd = -1;
+    struct stat st;
+    int64_t size = -1;
+    *file_content = NULL;
+    if ((fd=open(file_name, O_RDONLY)) >= 0 && fstat(fd, &st) == 0) {
+        if (!S_ISREG(st.st_mode)) {
+            size = ReadFile(fd, file_content);
+        } else if (st.st_size == 0) {
+            size = 0;
+        } else {
+            void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) {
+                madvise(map, st.st_size, MADV_SEQUENTIAL);
+                *file_content = (char*)map;
+                size = st.st_size;
+            }
+        }
+    }
+    if (fd >= 0 && close(fd) < 0 && size >= 0) {
+        if (*file_content != NULL) {
+            munmap(*file_content, size);
+            *file_content = NULL;
+        }
+        size = -1;
+    }
+    return size;
+}
+
+// Same as LoadFile, but exits on errors.
+inline int64_t LoadFileOrDie(const char* file_name, char** file_content) {
+    int64_t size = LoadFile(file_name, file_content);
+    if (size < 0) {
+        fprintf(stderr, "Can't load file: %s\n", file_name);
+        exit(1);
+    }
+    return size;
+}
+
+// Releases a buffer returned by LoadFile or LoadFileOrDie.
+inline void UnloadFile(char* file_content, int64_t file_size) {
+    if (file_content != NULL) {
+        munmap(file_content, file_size);
+    }
+}
+
+// Returns the Levenshtein distance to change file1_data into file2_data.
+inline int64_t LevDistance(char* file1_data, int64_t file1_size,
+             char* file2_data, int64_t file2_size) {
+    int64_t sz = file2_size+1;
+    std::vector<int64_t> current(sz);
+    std::vector<int64_t> previous(sz);
+    for (int64_t i=0; i < sz; ++i) {
+        previous[i] = i;
+    }
+
+    for (int64_t i=0; i < file1_size; ++i) {
+        current[0] = i+1;
+        for (int64_t j=1 ; j < sz; ++j) {
+            current[j] = std::min( std::min(previous[j], current[j-1])+1, 
+                previous[j-1]+(file1_data[i] != file2_data[j-1] ? 1 : 0));
+        }
+        std::swap(current, previous);
+    }
+    return previous[sz-1];
+}
+
+// Threshold-bounded version (E. Ukkonen's band): answers "is the distance
+// at most max_distance?" looking only at the diagonal band of width
+// 2*max_distance+1, since a path leaving the band costs more than that.
+// Stops as soon as every cell of a row is above max_distance.
+//
+// Returns the distance if it is <= max_distance, max_distance+1 otherwise.
+//
+// Operations: O(max_distance*min(m, n))
+// Memory: O(max_distance)
+//
+// current_row and previous_row are scratch rows, so that callers running
+// many comparisons can reuse them.
+inline int64_t LevDistanceBounded(char* file1_data, int64_t file1_size,
+                                  char* file2_data, int64_t file2_size,
+                                  int64_t max_distance,
+                                  std::vector<int64_t>* current_row,
+                                  std::vector<int64_t>* previous_row) {
+    // The distance never exceeds the longer input: a larger max_distance
+    // only costs memory, and max_distance+1 could overflow.
+    max_distance = std::min(max_distance, std::max(file1_size, file2_size));
+    const int64_t over = max_distance+1;
+    if (std::max(file1_size, file2_size)-std::min(file1_size, file2_size) >
+        max_distance) {
+        return over;
+    }
+    if (file1_size > file2_size) {
+        std::swap(file1_data, file2_data);
+        std::swap(file1_size, file2_size);
+    }
+
+    // Cell (i, j) is stored at index j-i+max_distance of its row. Every cell
+    // of the band only reads cells of the band, so the rows are never reset.
+    const int64_t width = 2*max_distance+1;
+    std::vector<int64_t>& current = *current_row;
+    std::vector<int64_t>& previous = *previous_row;
+    current.assign(width, over);
+    previous.assign(width, over);
+    for (int64_t j=0; j <= std::min(file2_size, max_distance); ++j) {
+        previous[j+max_distance] = j;
+    }
+
+    for (int64_t i=1; i <= file1_size; ++i) {
+        const int64_t first = std::max(int64_t(0), i-max_distance);
+        const int64_t last = std::min(file2_size, i+max_distance);
+        int64_t row_min = over;
+        for (int64_t j=first; j <= last; ++j) {
+            const int64_t t = j-i+max_distance;
+            int64_t cell = i;
+            if (j > 0) {
+                const int64_t up = t+1 < width ? previous[t+1] : over;
+                const int64_t left = t > 0 ? current[t-1] : over;
+                cell = std::min(std::min(up, left)+1, previous[t]+
+                    (file1_data[i-1] != file2_data[j-1] ? 1 : 0));
+            }
+            current[t] = std::min(cell, over);
+            row_min = std::min(row_min, current[t]);
+        }
+        if (row_min > max_distance) {
+            return over;
+        }
+        std::swap(current, previous);
+    }
+    return previous[file2_size-file1_size+max_distance];
+}
+
+inline int64_t LevDistanceBounded(char* file1_data, int64_t file1_size,
+                                  char* file2_data, int64_t file2_size,
+                                  int64_t max_distance) {
+    std::vector<int64_t> current;
+    std::vector<int64_t> previous;
+    return LevDistanceBounded(file1_data, file1_size, file2_data, file2_size,
+                              max_distance, &current, &previous);
+}
+
+// Bit-parallel engine (G. Myers, "A fast bit-vector algorithm for approximate
+// string matching based on dynamic programming", 1999 - in the blocked
+// formulation for global distance by H. Hyyro).
+//
+// The shorter input is the "pattern": each column of the DP matrix is stored
+// as vertical deltas (+1/-1) in two bit-vectors Pv/Mv, 64 cells per word.
+// The longer input is scanned one byte at a time and every word of the
+// column is advanced with a handful of logic and add instructions.
+//
+// Operations: O(m*n/64)
+// Memory: O(m/64 * alphabet) for the match table
+
+// Advances one 64 cells block of the column by one text character.
+// eq is the match mask of the text character against this block, hin the
+// horizontal delta entering the block from above and high the bit of the
+// last meaningful cell of the block.
+// Returns the horizontal delta leaving the block from below.
+inline int AdvanceBlock(uint64_t eq, int hin, uint64_t high,
+                        uint64_t* pv, uint64_t* mv) {
+    uint64_t Pv = *pv;
+    uint64_t Mv = *mv;
+    uint64_t Xv = eq | Mv;
+    if (hin < 0) {
+        eq |= 1;
+    }
+    uint64_t Xh = (((eq & Pv) + Pv) ^ Pv) | eq;
+    uint64_t Ph = Mv | ~(Xh | Pv);
+    uint64_t Mh = Pv & Xh;
+
+    int hout = 0;
+    if (Ph & high) {
+        hout = 1;
+    } else if (Mh & high) {
+        hout = -1;
+    }
+
+    Ph <<= 1;
+    Mh <<= 1;
+    if (hin < 0) {
+        Mh |= 1;
+    } else if (hin > 0) {
+        Ph |= 1;
+    }
+    *pv = Mh | ~(Xv | Ph);
+    *mv = Ph & Xv;
+    return hout;
+}
+
+// Single word version, for patterns up to 64 bytes.
+inline int64_t BitParallelLevDistance64(const unsigned char* pattern,
+                                        int64_t pattern_size,
+                                        const unsigned char* text,
+                                        int64_t text_size) {
+    uint64_t peq[256] = {0};
+    for (int64_t i=0; i < pattern_size; ++i) {
+        peq[pattern[i]] |= uint64_t(1) << i;
+    }
+
+    const uint64_t high = uint64_t(1) << (pattern_size-1);
+    uint64_t pv = ~uint64_t(0);
+    uint64_t mv = 0;
+    int64_t score = pattern_size;
+    for (int64_t j=0; j < text_size; ++j) {
+        // The first row of the matrix is 0, 1, 2, ... so hin is always +1
+        score += AdvanceBlock(peq[text[j]], 1, high, &pv, &mv);
+    }
+    return score;
+}
+
+// Multi-word (blocked) version: the column is split in ceil(m/64) words and
+// the horizontal delta is carried from each block to the next one.
+inline int64_t BlockedLevDistance(const unsigned char* pattern,
+                                  int64_t pattern_size,
+                                  const unsigned char* text,
+                                  int64_t text_size) {
+    const int64_t words = (pattern_size+63)/64;
+
+    // Only the symbols that appear in the pattern get a row in the match
+    // table, all the others share the all zero row 0. This keeps the table
+    // small on text inputs.
+    int symbol[256] = {0};
+    int symbols = 1;
+    for (int64_t i=0; i < pattern_size; ++i) {
+        if (symbol[pattern[i]] == 0) {
+            symbol[pattern[i]] = symbols++;
+        }
+    }
+
+    std::vector<uint64_t> peq(size_t(symbols)*words, 0);
+    for (int64_t i=0; i < pattern_size; ++i) {
+        peq[size_t(symbol[pattern[i]])*words + i/64] |= uint64_t(1) << (i%64);
+    }
+
+    std::vector<uint64_t> pv(words, ~uint64_t(0));
+    std::vector<uint64_t> mv(words, 0);
+    const uint64_t high = uint64_t(1) << 63;
+    const uint64_t last_high = uint64_t(1) << ((pattern_size-1)%64);
+    int64_t score = pattern_size;
+    for (int64_t j=0; j < text_size; ++j) {
+        const uint64_t* eq = &peq[size_t(symbol[text[j]])*words];
+        int h = 1;
+        for (int64_t b=0; b < words-1; ++b) {
+            h = AdvanceBlock(eq[b], h, high, &pv[b], &mv[b]);
+        }
+        score += AdvanceBlock(eq[words-1], h, last_high,
+                              &pv[words-1], &mv[words-1]);
+    }
+    return score;
+}
+
+// Returns the Levenshtein distance to change file1_data into file2_data.
+// The distance is symmetric, so the shorter input is used as pattern.
+inline int64_t BitParallelLevDistance(char* file1_data, int64_t file1_size,
+                                      char* file2_data, int64_t file2_size) {
+    if (file1_size > file2_size) {
+        std::swap(file1_data, file2_data);
+        std::swap(file1_size, file2_size);
+    }
+    if (file1_size == 0) {
+        return file2_size;
+    }
+
+    const unsigned char* pattern = (const unsigned char*)file1_data;
+    const unsigned char* text = (const unsigned char*)file2_data;
+    if (file1_size <= 64) {
+        return BitParallelLevDistance64(pattern, file1_size, text, file2_size);
+    }
+    return BlockedLevDistance(pattern, file1_size, text, file2_size);
+}
+
+// Multithreaded CPU port of the CudaLevDistance wavefront.
+//
+// Instead of one GPU thread per cell, the matrix is cut in TILE x TILE tiles
+// and the anti-diagonals of tiles are computed one after the other: all the
+// tiles of a diagonal are independent, so they are shared among a pool of
+// threads that meet on a barrier at the end of every diagonal. As in
+// CudaLevDistance, the number of tiles in a diagonal first grows (stage0),
+// then stays constant (stage1) and finally shrinks (stage2).
+//
+// Every tile reads the row above it from row and the column on its left from
+// column, and overwrites them with its own last row and column. The whole
+// state is O(m+n) and a tile works on TILE cells at a time, that fit in L1.
+//
+// Operations: O(m*n/threads)
+// Memory: O(m+n)
+
+#define TILE 1024
+
+class LevWavefront
+{
+public:
+    LevWavefront(char* file1_data, int64_t file1_size,
+                 char* file2_data, int64_t file2_size, int threads) :
+        a(file1_data), b(file2_data), m(file1_size), n(file2_size),
+        tile_rows((file1_size+TILE-1)/TILE),
+        tile_columns((file2_size+TILE-1)/TILE),
+        threads(threads), row(file2_size+1), column(file1_size+1),
+        corner(tile_rows) {
+        for (int64_t j=0; j <= n; ++j) {
+            row[j] = j;
+        }
+        for (int64_t i=0; i <= m; ++i) {
+            column[i] = i;
+        }
+        pthread_barrier_init(&barrier, NULL, threads);
+    }
+
+    ~LevWavefront() {
+        pthread_barrier_destroy(&barrier);
+    }
+
+    int64_t Run() {
+        std::vector< Result<int> > workers;
+        for (int t=1; t < threads; ++t) {
+            workers.push_back(Thread::run(this, &LevWavefront::Worker, t));
+        }
+        Worker(0);
+        for (size_t t=0; t < workers.size(); ++t) {
+            workers[t].value();
+        }
+        return row[n];
+    }
+
+private:
+    int Worker(int id) {
+        for (int64_t d=0; d < tile_rows+tile_columns-1; ++d) {
+            const int64_t first = std::max(int64_t(0), d-tile_columns+1);
+            const int64_t last = std::min(d, tile_rows-1);
+            for (int64_t ti=first+id; ti <= last; ti += threads) {
+                Tile(ti, d-ti);
+            }
+            pthread_barrier_wait(&barrier);
+        }
+        return 0;
+    }
+
+    void Tile(int64_t ti, int64_t tj) {
+        const int64_t i0 = ti*TILE;
+        const int64_t i1 = std::min(i0+TILE, m);
+        const int64_t j0 = tj*TILE;
+        const int64_t j1 = std::min(j0+TILE, n);
+
+        // The top-left corner is the old top-right corner of the tile on the
+        // left: that tile has already overwritten row[j0] with its last row.
+        int64_t diag = tj == 0 ? i0 : corner[ti];
+        corner[ti] = row[j1];
+
+        int64_t* r = &row[0];
+        for (int64_t i=i0; i < i1; ++i) {
+            const char c = a[i];
+            int64_t left = column[i+1];
+            const int64_t next_diag = left;
+            for (int64_t j=j0; j < j1; ++j) {
+                const int64_t up = r[j+1];
+                const int64_t curr = std::min(std::min(up, left)+1,
+                    diag+(c != b[j] ? 1 : 0));
+                diag = up;
+                r[j+1] = curr;
+                left = curr;
+            }
+            column[i+1] = left;
+            diag = next_diag;
+        }
+    }
+
+    const char* a;
+    const char* b;
+    const int64_t m;
+    const int64_t n;
+    const int64_t tile_rows;
+    const int64_t tile_columns;
+    const int threads;
+    std::vector<int64_t> row;
+    std::vector<int64_t> column;
+    std::vector<int64_t> corner;
+    pthread_barrier_t barrier;
+
+    LevWavefront(const LevWavefront&);
+    LevWavefront& operator=(const LevWavefront&);
+};
+
+// Returns the Levenshtein distance to change file1_data into file2_data,
+// using threads threads (or one per online CPU if threads <= 0).
+inline int64_t WavefrontLevDistance(char* file1_data, int64_t file1_size,
+                                    char* file2_data, int64_t file2_size,
+                                    int threads=0) {
+    if (file1_size == 0 || file2_size == 0) {
+        return std::max(file1_size, file2_size);
+    }
+    if (threads <= 0) {
+        threads = std::max(1, int(sysconf(_SC_NPROCESSORS_ONLN)));
+    }
+    LevWavefront wavefront(file1_data, file1_size, file2_data, file2_size,
+                           threads);
+    return wavefront.Run();
+}
+#endif
@@ -0,0 +1,303 @@
+// Copyright 2012 - Stefano Brilli : stefanobrilli@gmail.com
+//
+// Computes the Levenshtein distance between 2 files without a GPU.
+// Checks the CPU engines of lev_distance.h against the reference LevDistance.
+//
+// sample usage:
+// $ ./lev_distance_cpu [-t threads] [-f] [-k max_distance] [-e] file1 file2
+// $ ./lev_distance_cpu -l|-w file1 file2
+// $ ./lev_distance_cpu -a min_anchor file1 file2
+// $ ./lev_distance_cpu -s max_distance pattern text
+// $ ./lev_distance_cpu [-t threads] -n top_n query candidates
+//
+// With -f skips the reference LevDistance, which takes hours on large files,
+// and only checks the CPU engines against each other.
+//
+// With -k only checks if the distance is at most max_distance, computing
+// the diagonal band of the matrix (see LevDistanceBounded), and exits with
+// status 2 if it isn't.
+//
+// With -e prints the edit script to change file1 into file2, one edit per
+// line: the operation (see Edit), the positions in file1 and file2 and the
+// byte deleted (D) or written (S, I) in hex.
+//
+// With -l (-w) the distance is counted in lines (words) instead of bytes.
+//
+// With -a trims the common prefix and suffix and, if min_anchor > 0, runs
+// the DP only between exact matches of at least min_anchor bytes. The result
+// is marked as an upper bound when it may not be exact.
+//
+// With -s prints every offset where a match of pattern with at most
+// max_distance edits ends inside text, with its distance. The text is read in
+// chunks and can be a pipe ("-" for stdin).
+//
+// With -n compares query against every file in the candidates directory (or
+// listed in the candidates file, one per line) and prints the top_n closest.
+//
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "lev_distance.h"
+#include "lev_simd.h"
+#include "lev_edit_script.h"
+#include "lev_batch.h"
+#include "lev_tokens.h"
+#include "lev_anchors.h"
+#include "lev_search.h"
+
+// Wall clock time in seconds: clock() sums the time of all the threads.
+double WallTime() {
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec*1e-6;
+}
+
+int main(int argc, char** argv) {
+    int threads = 0;
+    int64_t max_distance = -1;
+    bool edit_script = false;
+    bool fast = false;
+    int top_n = 0;
+    int token_mode = -1;
+    int64_t min_anchor = -1;
+    int64_t search_distance = -1;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:fk:en:lwa:s:")) != -1) {
+        switch (opt) {
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'f':
+                fast = true;
+                break;
+            case 'k':
+                max_distance = atoll(optarg);
+                break;
+            case 'e':
+                edit_script = true;
+                break;
+            case 'n':
+                top_n = atoi(optarg);
+                break;
+            case 'l':
+                token_mode = TOKEN_LINES;
+                break;
+            case 'w':
+                token_mode = TOKEN_WORDS;
+                break;
+            case 'a':
+                min_anchor = atoll(optarg);
+                break;
+            case 's':
+                search_distance = atoll(optarg);
+                break;
+            default:
+                optind = argc+1;
+        }
+    }
+    if (argc-optind != 2) {
+        fprintf(stderr, "Usage: %s [-t threads] [-f] [-k max_distance] [-e] "
+                "file1 file2\n", argv[0]);
+        fprintf(stderr, "       %s -l|-w file1 file2\n", argv[0]);
+        fprintf(stderr, "       %s -a min_anchor file1 file2\n", argv[0]);
+        fprintf(stderr, "       %s -s max_distance pattern text\n", argv[0]);
+        fprintf(stderr, "       %s [-t threads] -n top_n query candidates\n",
+                argv[0]);
+        return 1;
+    }
+    const char* file1_name = argv[optind];
+    const char* file2_name = argv[optind+1];
+
+    if (top_n > 0) {
+        std::vector<std::string> candidates;
+        if (!ListCandidates(file2_name, &candidates)) {
+            fprintf(stderr, "Can't list candidates: %s\n", file2_name);
+            return 1;
+        }
+        char* query = NULL;
+        int64_t query_size = LoadFileOrDie(file1_name, &query);
+        printf("%s size is %lld bytes, %d candidates\n", file1_name,
+               (long long)query_size, int(candidates.size()));
+
+        double timer = WallTime();
+        printf("LevBatchSearch...\n");
+        std::vector<LevMatch> best;
+        LevBatchSearch(query, query_size, candidates, top_n, &best, threads);
+        printf("elapsed time: %.3f (s)\n", WallTime()-timer);
+
+        for (size_t k=0; k < best.size(); ++k) {
+            printf("%lld %s\n", (long long)best[k].distance,
+                   candidates[best[k].candidate].c_str());
+        }
+        UnloadFile(query, query_size);
+        return 0;
+    }
+
+    if (search_distance >= 0) {
+        char* pattern = NULL;
+        int64_t pattern_size = LoadFileOrDie(file1_name, &pattern);
+        int fd = strcmp(file2_name, "-") == 0 ? 0 : open(file2_name, O_RDONLY);
+        if (pattern_size == 0 || fd < 0) {
+            fprintf(stderr, "Can't search %s in %s\n", file1_name, file2_name);
+            return 1;
+        }
+
+        LevSearch search(pattern, pattern_size, search_distance);
+        std::vector<char> chunk(SEARCH_CHUNK);
+        std::vector<SearchMatch> matches;
+        ssize_t got;
+        while ((got = read(fd, &chunk[0], chunk.size())) != 0) {
+            if (got < 0) {
+                fprintf(stderr, "Can't read file: %s\n", file2_name);
+                return 1;
+            }
+            matches.clear();
+            search.Feed(&chunk[0], got, &matches);
+            for (size_t k=0; k < matches.size(); ++k) {
+                printf("%lld %lld\n", (long long)matches[k].end,
+                       (long long)matches[k].distance);
+            }
+        }
+        close(fd);
+        UnloadFile(pattern, pattern_size);
+        return 0;
+    }
+
+    char* file1 = NULL;
+    int64_t file1_size = LoadFileOrDie(file1_name, &file1);
+
+    char* file2 = NULL;
+    int64_t file2_size = LoadFileOrDie(file2_name, &file2);
+
+    printf("%s size is %lld bytes\n", file1_name, (long long)file1_size);
+    printf("%s size is %lld bytes\n", file2_name, (long long)file2_size);
+
+    if (max_distance >= 0) {
+        double timer = WallTime();
+        printf("LevDistanceBounded...\n");
+        int64_t bd = LevDistanceBounded(file1, file1_size, file2, file2_size,
+                                        max_distance);
+        printf("elapsed time: %.3f (s)\n", WallTime()-timer);
+        if (bd <= max_distance) {
+            printf("Distance: %lld\n", (long long)bd);
+        } else {
+            printf("Distance: > %lld\n", (long long)max_distance);
+        }
+        UnloadFile(file1, file1_size);
+        UnloadFile(file2, file2_size);
+        return bd <= max_distance ? 0 : 2;
+    }
+
+    if (token_mode >= 0) {
+        double timer = WallTime();
+        printf("TokenLevDistance...\n");
+        int64_t tokens1 = 0;
+        int64_t tokens2 = 0;
+        int64_t td = TokenLevDistance(file1, file1_size, file2, file2_size,
+                                      TokenMode(token_mode), &tokens1,
+                                      &tokens2);
+        printf("elapsed time: %.3f (s)\n", WallTime()-timer);
+        const char* unit = token_mode == TOKEN_LINES ? "lines" : "words";
+        printf("%s has %lld %s\n", file1_name, (long long)tokens1, unit);
+        printf("%s has %lld %s\n", file2_name, (long long)tokens2, unit);
+        printf("Distance: %lld %s\n", (long long)td, unit);
+        UnloadFile(file1, file1_size);
+        UnloadFile(file2, file2_size);
+        return 0;
+    }
+
+    if (min_anchor >= 0) {
+        double timer = WallTime();
+        printf("AnchoredLevDistance...\n");
+        bool exact = false;
+        int64_t ad = AnchoredLevDistance(file1, file1_size, file2, file2_size,
+                                         min_anchor, &exact);
+        printf("elapsed time: %.3f (s)\n", WallTime()-timer);
+        if (exact) {
+            printf("Distance: %lld\n", (long long)ad);
+        } else {
+            printf("Distance: <= %lld (upper bound)\n", (long long)ad);
+        }
+        UnloadFile(file1, file1_size);
+        UnloadFile(file2, file2_size);
+        return 0;
+    }
+
+    if (edit_script) {
+        double timer = WallTime();
+        printf("LevEditScriptOf...\n");
+        std::vector<Edit> script;
+        int64_t sd = LevEditScriptOf(file1, file1_size, file2, file2_size,
+                                     &script, threads);
+        printf("elapsed time: %.3f (s)\n", WallTime()-timer);
+
+        for (size_t k=0; k < script.size(); ++k) {
+            const Edit& e = script[k];
+            unsigned char c = e.op == 'D' ? file1[e.pos1] : file2[e.pos2];
+            printf("%c %lld %lld %02x\n", e.op, (long long)e.pos1,
+                   (long long)e.pos2, c);
+        }
+
+        if (sd != BitParallelLevDistance(file1, file1_size,
+                                         file2, file2_size)) {
+            fprintf(stderr, "CRITICAL: edit script is not minimal!");
+            exit(1);
+        }
+        printf("Distance: %lld\n", (long long)sd);
+        UnloadFile(file1, file1_size);
+        UnloadFile(file2, file2_size);
+        return 0;
+    }
+
+    if (file1_size > file2_size) {
+        std::swap(file1_size, file2_size);
+        std::swap(file1, file2);
+    }
+
+    // -1: not computed, the engines are only checked against each other
+    int64_t ld = -1;
+    double timer = WallTime();
+    if (!fast) {
+        printf("LevDistance...\n");
+        ld = LevDistance(file1, file1_size, file2, file2_size);
+        printf("elapsed time: %.3f (s)\n", WallTime()-timer);
+    }
+
+    timer = WallTime();
+    printf("BitParallelLevDistance...\n");
+    int64_t bld = BitParallelLevDistance(file1, file1_size, file2, file2_size);
+    printf("elapsed time: %.3f (s)\n", WallTime()-timer);
+
+    timer = WallTime();
+    printf("WavefrontLevDistance...\n");
+    int64_t wld = WavefrontLevDistance(file1, file1_size, file2, file2_size,
+                                       threads);
+    printf("elapsed time: %.3f (s)\n", WallTime()-timer);
+
+    timer = WallTime();
+    printf("SimdLevDistance (%s)...\n", SimdIsaName(DetectSimdIsa()));
+    int64_t sld = SimdLevDistance(file1, file1_size, file2, file2_size);
+    printf("elapsed time: %.3f (s)\n", WallTime()-timer);
+
+    if (fast) {
+        ld = bld;
+    }
+    if (ld != bld || ld != wld || ld != sld) {
+        fprintf(stderr, "CRITICAL: LevDistance result differs from CPU engines!");
+        exit(1);
+    } else {
+        printf("OK: CPU Results match!\n");
+    }
+
+    printf("Distance: %lld\n", (long long)ld);
+
+    UnloadFile(file1, file1_size);
+    UnloadFile(file2, file2_size);
+
+    return 0;
+}
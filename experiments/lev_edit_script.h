@@ -0,0 +1,306 @@
+// Copyright 2012 - Stefano Brilli : stefanobrilli@gmail.com
+//
+// Edit script between 2 files, in linear space (D. S. Hirschberg, "A linear
+// space algorithm for computing maximal common subsequences", 1975).
+//
+// The longer input a is split in half: the last row of the matrix for the
+// first half against b, and the one for the reversed second half against
+// the reversed b, are computed with the two rows current/previous of
+// LevDistance. The column where their sum is minimal is crossed by an
+// optimal path, so the problem splits in two independent sub-problems that
+// are solved recursively, on a new thread while there are spare ones.
+//
+// Operations: O(m*n)
+// Memory: O(min(m, n)) per thread, plus the script itself
+
+#ifndef _LEV_EDIT_SCRIPT_H_
+#define _LEV_EDIT_SCRIPT_H_
+
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+#include <unistd.h>
+#include "lev_distance.h"
+#include "thread.h"
+
+// Sub-problems smaller than this are solved on the full matrix
+#define SCRIPT_BASE_CELLS (1 << 16)
+// Sub-problems smaller than this are never moved to another thread
+#define SCRIPT_THREAD_CELLS (1 << 22)
+
+// One operation to change file1 into file2:
+// 'S' replaces file1[pos1] with file2[pos2]
+// 'I' inserts file2[pos2] before file1[pos1]
+// 'D' removes file1[pos1] (that would be before file2[pos2])
+struct Edit
+{
+    Edit(char op, int64_t pos1, int64_t pos2) :
+        op(op), pos1(pos1), pos2(pos2) {}
+    char op;
+    int64_t pos1;
+    int64_t pos2;
+};
+
+// Computes in previous the last row of the matrix of a (m bytes) against b
+// (n bytes), scanning both inputs backwards if reverse is set.
+// current is a scratch row; both are resized to n+1.
+inline void LevLastRow(const char* a, int64_t m, const char* b, int64_t n,
+                       bool reverse, std::vector<int64_t>* previous_row,
+                       std::vector<int64_t>* current_row) {
+    std::vector<int64_t>& previous = *previous_row;
+    std::vector<int64_t>& current = *current_row;
+    const int64_t step = reverse ? -1 : 1;
+    if (reverse) {
+        a += m-1;
+        b += n-1;
+    }
+
+    int64_t sz = n+1;
+    current.resize(sz);
+    previous.resize(sz);
+    for (int64_t i=0; i < sz; ++i) {
+        previous[i] = i;
+    }
+
+    for (int64_t i=0; i < m; ++i) {
+        const char c = a[i*step];
+        current[0] = i+1;
+        for (int64_t j=1 ; j < sz; ++j) {
+            current[j] = std::min( std::min(previous[j], current[j-1])+1,
+                previous[j-1]+(c != b[(j-1)*step] ? 1 : 0));
+        }
+        std::swap(current, previous);
+    }
+}
+
+class LevEditScript
+{
+public:
+    LevEditScript(const char* a, int64_t m, const char* b, int64_t n,
+                  int threads) : a(a), b(b), m(m), n(n),
+                  spare_threads(threads-1) {}
+
+    // Appends to script the edits to change a into b
+    void Run(std::vector<Edit>* script) {
+        Task task(0, m, 0, n, script);
+        Solve(&task);
+    }
+
+private:
+    // a[a0, a0+m) against b[b0, b0+n)
+    struct Task
+    {
+        Task(int64_t a0, int64_t m, int64_t b0, int64_t n,
+             std::vector<Edit>* script) :
+            a0(a0), m(m), b0(b0), n(n), reverse(false), script(script) {}
+        int64_t a0;
+        int64_t m;
+        int64_t b0;
+        int64_t n;
+        bool reverse;
+        std::vector<Edit>* script;
+        std::vector<int64_t> row;
+        std::vector<int64_t> scratch;
+    };
+
+    int LastRow(Task* t) {
+        LevLastRow(a+t->a0, t->m, b+t->b0, t->n, t->reverse,
+                   &t->row, &t->scratch);
+        return 0;
+    }
+
+    // Reserves a thread for a sub-problem of cells cells, if any is spare
+    bool AcquireThread(int64_t cells) {
+        if (cells < SCRIPT_THREAD_CELLS) {
+            return false;
+        }
+        if (__sync_fetch_and_sub(&spare_threads, 1) > 0) {
+            return true;
+        }
+        __sync_fetch_and_add(&spare_threads, 1);
+        return false;
+    }
+
+    void ReleaseThread() {
+        __sync_fetch_and_add(&spare_threads, 1);
+    }
+
+    int Solve(Task* t) {
+        std::vector<Edit>& script = *t->script;
+        if (t->m == 0) {
+            for (int64_t j=0; j < t->n; ++j) {
+                script.push_back(Edit('I', t->a0, t->b0+j));
+            }
+        } else if (t->n == 0) {
+            for (int64_t i=0; i < t->m; ++i) {
+                script.push_back(Edit('D', t->a0+i, t->b0));
+            }
+        } else if (t->m == 1) {
+            SolveSingleRow(t);
+        } else if ((t->m+1)*(t->n+1) <= SCRIPT_BASE_CELLS) {
+            SolveFullMatrix(t);
+        } else {
+            Split(t);
+        }
+        return 0;
+    }
+
+    void Split(Task* t) {
+        const int64_t mid = t->m/2;
+        Task forward(t->a0, mid, t->b0, t->n, NULL);
+        Task backward(t->a0+mid, t->m-mid, t->b0, t->n, NULL);
+        backward.reverse = true;
+        if (AcquireThread(mid*t->n)) {
+            Result<int> r = Thread::run(this, &LevEditScript::LastRow,
+                                        &forward);
+            LastRow(&backward);
+            r.value();
+            ReleaseThread();
+        } else {
+            LastRow(&forward);
+            LastRow(&backward);
+        }
+
+        // backward.row[k] is the distance of the second half of a from the
+        // last k bytes of b
+        int64_t split = 0;
+        int64_t best = forward.row[0]+backward.row[t->n];
+        for (int64_t j=1; j <= t->n; ++j) {
+            if (forward.row[j]+backward.row[t->n-j] < best) {
+                best = forward.row[j]+backward.row[t->n-j];
+                split = j;
+            }
+        }
+        // Frees the rows before going down
+        std::vector<int64_t>().swap(forward.row);
+        std::vector<int64_t>().swap(forward.scratch);
+        std::vector<int64_t>().swap(backward.row);
+        std::vector<int64_t>().swap(backward.scratch);
+
+        std::vector<Edit> left_script;
+        Task left(t->a0, mid, t->b0, split, &left_script);
+        Task right(t->a0+mid, t->m-mid, t->b0+split, t->n-split, t->script);
+        if (AcquireThread(mid*split)) {
+            Result<int> r = Thread::run(this, &LevEditScript::Solve, &left);
+            std::vector<Edit> right_script;
+            right.script = &right_script;
+            Solve(&right);
+            r.value();
+            ReleaseThread();
+            t->script->insert(t->script->end(), left_script.begin(),
+                              left_script.end());
+            t->script->insert(t->script->end(), right_script.begin(),
+                              right_script.end());
+        } else {
+            left.script = t->script;
+            Solve(&left);
+            Solve(&right);
+        }
+    }
+
+    // a single byte against b: keeps it on its first match in b, if any
+    void SolveSingleRow(Task* t) {
+        std::vector<Edit>& script = *t->script;
+        const char c = a[t->a0];
+        int64_t keep = 0;
+        while (keep < t->n && b[t->b0+keep] != c) {
+            ++keep;
+        }
+        const bool match = keep < t->n;
+        if (!match) {
+            keep = 0;
+        }
+        for (int64_t j=0; j < keep; ++j) {
+            script.push_back(Edit('I', t->a0, t->b0+j));
+        }
+        if (!match) {
+            script.push_back(Edit('S', t->a0, t->b0));
+        }
+        for (int64_t j=keep+1; j < t->n; ++j) {
+            script.push_back(Edit('I', t->a0+1, t->b0+j));
+        }
+    }
+
+    // Small sub-problems: the whole matrix and a walk back from the end
+    void SolveFullMatrix(Task* t) {
+        const char* x = a+t->a0;
+        const char* y = b+t->b0;
+        const int64_t w = t->n+1;
+        std::vector<int> d((t->m+1)*w);
+        for (int64_t j=0; j <= t->n; ++j) {
+            d[j] = int(j);
+        }
+        for (int64_t i=1; i <= t->m; ++i) {
+            d[i*w] = int(i);
+            for (int64_t j=1; j <= t->n; ++j) {
+                d[i*w+j] = std::min(std::min(d[(i-1)*w+j], d[i*w+j-1])+1,
+                    d[(i-1)*w+j-1]+(x[i-1] != y[j-1] ? 1 : 0));
+            }
+        }
+
+        std::vector<Edit> reversed;
+        int64_t i = t->m;
+        int64_t j = t->n;
+        while (i > 0 || j > 0) {
+            if (i > 0 && j > 0 && d[i*w+j] ==
+                d[(i-1)*w+j-1]+(x[i-1] != y[j-1] ? 1 : 0)) {
+                --i;
+                --j;
+                if (x[i] != y[j]) {
+                    reversed.push_back(Edit('S', t->a0+i, t->b0+j));
+                }
+            } else if (i > 0 && d[i*w+j] == d[(i-1)*w+j]+1) {
+                --i;
+                reversed.push_back(Edit('D', t->a0+i, t->b0+j));
+            } else {
+                --j;
+                reversed.push_back(Edit('I', t->a0+i, t->b0+j));
+            }
+        }
+        t->script->insert(t->script->end(), reversed.rbegin(),
+                          reversed.rend());
+    }
+
+    const char* a;
+    const char* b;
+    const int64_t m;
+    const int64_t n;
+    volatile int spare_threads;
+
+    LevEditScript(const LevEditScript&);
+    LevEditScript& operator=(const LevEditScript&);
+};
+
+// Fills script with the edits to change file1_data into file2_data and
+// returns the Levenshtein distance (the number of edits). Uses up to
+// threads threads (or one per online CPU if threads <= 0).
+inline int64_t LevEditScriptOf(char* file1_data, int64_t file1_size,
+                               char* file2_data, int64_t file2_size,
+                               std::vector<Edit>* script, int threads=0) {
+    if (threads <= 0) {
+        threads = std::max(1, int(sysconf(_SC_NPROCESSORS_ONLN)));
+    }
+    script->clear();
+
+    // The rows run along b, so b is the shorter input. When the inputs are
+    // swapped the script is mirrored: inserts become deletes and back.
+    if (file2_size <= file1_size) {
+        LevEditScript(file1_data, file1_size, file2_data, file2_size,
+                      threads).Run(script);
+        return script->size();
+    }
+    LevEditScript(file2_data, file2_size, file1_data, file1_size,
+                  threads).Run(script);
+    for (size_t k=0; k < script->size(); ++k) {
+        Edit& e = (*script)[k];
+        std::swap(e.pos1, e.pos2);
+        if (e.op == 'I') {
+            e.op = 'D';
+        } else if (e.op == 'D') {
+            e.op = 'I';
+        }
+    }
+    return script->size();
+}
+
+#endif
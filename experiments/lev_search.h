@@ -0,0 +1,122 @@
+// Copyright 2012 - Stefano Brilli : stefanobrilli@gmail.com
+//
+// Approximate search: every position of a text where a pattern ends with at
+// most max_distance edits (P. H. Sellers, "The theory and computation of
+// evolutionary distances: pattern recognition", 1980).
+//
+// It is the LevDistance recurrence with a free first row (a match can start
+// anywhere), computed with the bit-parallel columns of BitParallelLevDistance:
+// the horizontal delta entering the first block is 0 instead of +1. Only the
+// blocks that can still hold a cell <= max_distance are advanced (Myers'
+// cutoff), so short distances cost O(max_distance/64) words per byte.
+//
+// The text is fed in chunks of any size and the state is kept between them,
+// so it can be streamed from a file or a pipe in constant memory.
+//
+// Operations: O(n*max_distance/64) expected, O(n*m/64) worst case
+// Memory: O(m/64 * alphabet)
+
+#ifndef _LEV_SEARCH_H_
+#define _LEV_SEARCH_H_
+
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+#include "lev_distance.h"
+
+// Text bytes read at once when streaming
+#define SEARCH_CHUNK (1 << 20)
+
+struct SearchMatch
+{
+    SearchMatch(int64_t end, int64_t distance) :
+        end(end), distance(distance) {}
+    int64_t end;      // Text offset one past the last byte of the match
+    int64_t distance;
+};
+
+class LevSearch
+{
+public:
+    // Requires a pattern of at least one byte
+    LevSearch(const char* pattern, int64_t pattern_size,
+              int64_t max_distance) :
+        words((pattern_size+63)/64), max_distance(max_distance),
+        position(0), symbol(256, 0), pv(words, ~uint64_t(0)), mv(words, 0),
+        score(words), height(words, 64) {
+        const unsigned char* p = (const unsigned char*)pattern;
+        int symbols = 1;
+        for (int64_t i=0; i < pattern_size; ++i) {
+            if (symbol[p[i]] == 0) {
+                symbol[p[i]] = symbols++;
+            }
+        }
+        peq.assign(size_t(symbols)*words, 0);
+        for (int64_t i=0; i < pattern_size; ++i) {
+            peq[size_t(symbol[p[i]])*words + i/64] |= uint64_t(1) << (i%64);
+        }
+
+        height[words-1] = pattern_size-64*(words-1);
+        // Column 0 is D[i][0] = i: the blocks with a row <= max_distance
+        last = std::min(words-1, std::max(int64_t(0), max_distance-1)/64);
+        int64_t bottom = 0;
+        for (int64_t b=0; b < words; ++b) {
+            bottom += height[b];
+            score[b] = bottom;
+        }
+    }
+
+    // Appends to matches the matches that end inside the next size bytes of
+    // the text.
+    void Feed(const char* data, int64_t size,
+              std::vector<SearchMatch>* matches) {
+        const unsigned char* text = (const unsigned char*)data;
+        for (int64_t j=0; j < size; ++j) {
+            const uint64_t* eq = &peq[size_t(symbol[text[j]])*words];
+            int carry = 0; // Free first row
+            for (int64_t b=0; b <= last; ++b) {
+                carry = AdvanceBlock(eq[b], carry, High(b), &pv[b], &mv[b]);
+                score[b] += carry;
+            }
+
+            if (last < words-1 && score[last]-carry <= max_distance &&
+                ((eq[last+1] & 1) || carry < 0)) {
+                // The next block may get cells <= max_distance: it starts
+                // from a column of +1 deltas below the last active block.
+                ++last;
+                pv[last] = ~uint64_t(0);
+                mv[last] = 0;
+                score[last] = score[last-1]-carry+height[last]+
+                    AdvanceBlock(eq[last], carry, High(last),
+                                 &pv[last], &mv[last]);
+            } else {
+                while (last > 0 && score[last] >= max_distance+height[last]) {
+                    --last;
+                }
+            }
+
+            if (last == words-1 && score[last] <= max_distance) {
+                matches->push_back(SearchMatch(position+j+1, score[last]));
+            }
+        }
+        position += size;
+    }
+
+private:
+    uint64_t High(int64_t b) const {
+        return uint64_t(1) << (height[b]-1);
+    }
+
+    const int64_t words;
+    const int64_t max_distance;
+    int64_t position; // Text bytes fed so far
+    int64_t last;     // Last active block
+    std::vector<int> symbol;
+    std::vector<uint64_t> peq;
+    std::vector<uint64_t> pv;
+    std::vector<uint64_t> mv;
+    std::vector<int64_t> score;  // D at the last row of each block
+    std::vector<int64_t> height; // Rows of each block
+};
+
+#endif
@@ -0,0 +1,101 @@
+// Copyright 2012 - Stefano Brilli : stefanobrilli@gmail.com
+//
+// SIMD engine for the Levenshtein distance between 2 files.
+//
+// The anti-diagonal kernel (lev_simd_kernel.h) is built for SSE4.1 and AVX2
+// in two separate units and the instruction set is picked at runtime with
+// CPUID, so the same binary runs on every x86 host. Cells are 8 bit when
+// the distance fits, 16 bit otherwise and 32 bit only as last resort.
+//
+// Operations: O(m*n/lanes)
+// Memory: O(min(m, n)) cells
+//
+
+#ifndef _LEV_SIMD_H_
+#define _LEV_SIMD_H_
+
+#include <algorithm>
+#include <vector>
+#include "lev_distance.h"
+#include "lev_simd_entry.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LEV_SIMD_X86
+#endif
+
+enum SimdIsa { SIMD_NONE, SIMD_SSE41, SIMD_AVX2 };
+
+inline SimdIsa DetectSimdIsa() {
+#ifdef LEV_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return SIMD_SSE41;
+    }
+#endif
+    return SIMD_NONE;
+}
+
+inline const char* SimdIsaName(SimdIsa isa) {
+    switch (isa) {
+        case SIMD_AVX2:
+            return "avx2";
+        case SIMD_SSE41:
+            return "sse4.1";
+        default:
+            return "none";
+    }
+}
+
+// Returns the Levenshtein distance to change file1_data into file2_data.
+// Falls back to LevDistance on CPUs without SSE4.1, outside x86 and when
+// the distance could overflow the 32 bit cells.
+inline int64_t SimdLevDistance(char* file1_data, int64_t file1_size,
+                               char* file2_data, int64_t file2_size) {
+    if (file1_size > file2_size) {
+        std::swap(file1_data, file2_data);
+        std::swap(file1_size, file2_size);
+    }
+    if (file1_size == 0) {
+        return file2_size;
+    }
+
+#ifdef LEV_SIMD_X86
+    static const SimdIsa isa = DetectSimdIsa();
+    if (isa == SIMD_NONE || file2_size >= int64_t(0xffffffff)) {
+        return LevDistance(file1_data, file1_size, file2_data, file2_size);
+    }
+
+    // Scratch cells, allocated here so that the kernels instantiate nothing
+    // from the standard library, and shared by all the cell widths
+    std::vector<char> cells(LEV_SIMD_SCRATCH(file1_size));
+
+    // The length difference is a lower bound of the distance: skip the cell
+    // types that would saturate for sure, and widen when a kernel saturates.
+    const int64_t gap = file2_size-file1_size;
+    const int cell_bits[] = {8, 16, 32};
+    const int64_t cell_max[] = {0xff, 0xffff, 0};
+    for (int k=0; k < 3; ++k) {
+        if (cell_max[k] && gap >= cell_max[k]) {
+            continue;
+        }
+        const unsigned char* a = (const unsigned char*)file1_data;
+        const unsigned char* b = (const unsigned char*)file2_data;
+        int64_t result = isa == SIMD_AVX2 ?
+            Avx2LevDistance(a, file1_size, b, file2_size, cell_bits[k],
+                            &cells[0]) :
+            Sse41LevDistance(a, file1_size, b, file2_size, cell_bits[k],
+                             &cells[0]);
+        if (result >= 0) {
+            return result;
+        }
+    }
+    return -1;
+#else
+    return LevDistance(file1_data, file1_size, file2_data, file2_size);
+#endif
+}
+
+#endif
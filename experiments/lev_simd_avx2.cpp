@@ -0,0 +1,119 @@
+// Copyright 2012 - Stefano Brilli : stefanobrilli@gmail.com
+//
+// AVX2 instance of the anti-diagonal kernel: 32, 16 or 8 cells per vector.
+// This file is compiled with -mavx2, call it only if the CPU supports it,
+// and include nothing but lev_simd_kernel.h (see lev_simd_entry.h).
+//
+// b is read backwards: pshufb reverses the bytes (within each 128 bit lane
+// for the 8 bit cells, then the lanes are swapped) before they are compared
+// or zero extended.
+//
+
+#include <immintrin.h>
+#include "lev_simd_kernel.h"
+
+namespace {
+
+// Upper 128 bit lane, folded on the lower one by the HorizontalMin below.
+inline __m128i FoldLanes(__m256i v) {
+    return _mm256_extracti128_si256(v, 1);
+}
+
+struct Avx2U8
+{
+    typedef uint8_t T;
+    typedef __m256i Vec;
+    static const int LANES = 32;
+    static const T MAX = 0xff;
+
+    static Vec Set(T v) { return _mm256_set1_epi8(char(v)); }
+    static Vec Load(const T* p) { return _mm256_loadu_si256((const Vec*)p); }
+    static void Store(T* p, Vec v) { _mm256_storeu_si256((Vec*)p, v); }
+    static Vec Min(Vec a, Vec b) { return _mm256_min_epu8(a, b); }
+    static Vec Add(Vec a, Vec b) { return _mm256_adds_epu8(a, b); }
+    static Vec Cost(const unsigned char* a, const unsigned char* b, Vec one) {
+        const Vec reverse = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                             7, 6, 5, 4, 3, 2, 1, 0,
+                                             15, 14, 13, 12, 11, 10, 9, 8,
+                                             7, 6, 5, 4, 3, 2, 1, 0);
+        Vec rb = _mm256_shuffle_epi8(_mm256_loadu_si256((const Vec*)b),
+                                     reverse);
+        Vec eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const Vec*)a),
+                                   _mm256_permute2x128_si256(rb, rb, 1));
+        return _mm256_andnot_si256(eq, one);
+    }
+    static T HorizontalMin(Vec v) {
+        __m128i h = _mm_min_epu8(_mm256_castsi256_si128(v), FoldLanes(v));
+        h = _mm_min_epu8(h, _mm_srli_si128(h, 8));
+        h = _mm_min_epu8(h, _mm_srli_si128(h, 4));
+        h = _mm_min_epu8(h, _mm_srli_si128(h, 2));
+        h = _mm_min_epu8(h, _mm_srli_si128(h, 1));
+        return T(_mm_extract_epi8(h, 0));
+    }
+};
+
+struct Avx2U16
+{
+    typedef uint16_t T;
+    typedef __m256i Vec;
+    static const int LANES = 16;
+    static const T MAX = 0xffff;
+
+    static Vec Set(T v) { return _mm256_set1_epi16(short(v)); }
+    static Vec Load(const T* p) { return _mm256_loadu_si256((const Vec*)p); }
+    static void Store(T* p, Vec v) { _mm256_storeu_si256((Vec*)p, v); }
+    static Vec Min(Vec a, Vec b) { return _mm256_min_epu16(a, b); }
+    static Vec Add(Vec a, Vec b) { return _mm256_adds_epu16(a, b); }
+    static Vec Cost(const unsigned char* a, const unsigned char* b, Vec one) {
+        const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                              7, 6, 5, 4, 3, 2, 1, 0);
+        Vec eq = _mm256_cmpeq_epi16(
+            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)a)),
+            _mm256_cvtepu8_epi16(_mm_shuffle_epi8(
+                _mm_loadu_si128((const __m128i*)b), reverse)));
+        return _mm256_andnot_si256(eq, one);
+    }
+    static T HorizontalMin(Vec v) {
+        __m128i h = _mm_min_epu16(_mm256_castsi256_si128(v), FoldLanes(v));
+        return T(_mm_cvtsi128_si32(_mm_minpos_epu16(h)));
+    }
+};
+
+struct Avx2U32
+{
+    typedef uint32_t T;
+    typedef __m256i Vec;
+    static const int LANES = 8;
+    static const T MAX = 0xffffffff;
+
+    static Vec Set(T v) { return _mm256_set1_epi32(int(v)); }
+    static Vec Load(const T* p) { return _mm256_loadu_si256((const Vec*)p); }
+    static void Store(T* p, Vec v) { _mm256_storeu_si256((Vec*)p, v); }
+    static Vec Min(Vec a, Vec b) { return _mm256_min_epu32(a, b); }
+    // SimdLevDistance only uses 32 bit cells for inputs below 4GB
+    static Vec Add(Vec a, Vec b) { return _mm256_add_epi32(a, b); }
+    static Vec Cost(const unsigned char* a, const unsigned char* b, Vec one) {
+        const __m128i reverse = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0,
+                                              -1, -1, -1, -1, -1, -1, -1, -1);
+        Vec eq = _mm256_cmpeq_epi32(
+            _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)a)),
+            _mm256_cvtepu8_epi32(_mm_shuffle_epi8(
+                _mm_loadl_epi64((const __m128i*)b), reverse)));
+        return _mm256_andnot_si256(eq, one);
+    }
+    static T HorizontalMin(Vec v) {
+        __m128i h = _mm_min_epu32(_mm256_castsi256_si128(v), FoldLanes(v));
+        h = _mm_min_epu32(h, _mm_srli_si128(h, 8));
+        h = _mm_min_epu32(h, _mm_srli_si128(h, 4));
+        return T(_mm_cvtsi128_si32(h));
+    }
+};
+
+} // namespace
+
+int64_t Avx2LevDistance(const unsigned char* a, int64_t m,
+                        const unsigned char* b, int64_t n, int cell_bits,
+                        void* cells) {
+    return DiagonalLevDistance<Avx2U8, Avx2U16, Avx2U32>(a, m, b, n,
+                                                         cell_bits, cells);
+}
@@ -0,0 +1,29 @@
+// Copyright 2012 - Stefano Brilli : stefanobrilli@gmail.com
+//
+// Entry points of the SIMD kernels, shared by lev_simd.h and by the units
+// built with extended instruction sets. Keep it to plain declarations: an
+// inline or template function defined here would be compiled with -mavx2
+// in one unit and without it in the others, and the linker may keep the
+// AVX2 copy for everybody.
+//
+
+#ifndef _LEV_SIMD_ENTRY_H_
+#define _LEV_SIMD_ENTRY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LEV_SIMD_SCRATCH(m) (3*(size_t(m)+1)*sizeof(uint32_t))
+
+// Kernels: return the distance between a and b using cell_bits (8, 16 or
+// 32) wide cells, or -1 if the distance doesn't fit. They require
+// 0 < m <= n, and cells must point to a scratch buffer of
+// LEV_SIMD_SCRATCH(m) bytes, aligned for 32 bit cells.
+int64_t Sse41LevDistance(const unsigned char* a, int64_t m,
+                         const unsigned char* b, int64_t n, int cell_bits,
+                         void* cells);
+int64_t Avx2LevDistance(const unsigned char* a, int64_t m,
+                        const unsigned char* b, int64_t n, int cell_bits,
+                        void* cells);
+
+#endif
@@ -0,0 +1,138 @@
+// Copyright 2012 - Stefano Brilli : stefanobrilli@gmail.com
+//
+// Anti-diagonal SIMD kernel for the Levenshtein distance.
+//
+// This file is compiled once per instruction set (see lev_simd_sse41.cpp
+// and lev_simd_avx2.cpp) with the matching compiler flags, so everything
+// lives in an anonymous namespace and nothing from the standard library is
+// instantiated here: its inline code would be shared with the units built
+// without the extended flags.
+//
+// The cells of an anti-diagonal don't depend on each other: cell i of
+// diagonal d (row i, column d-i) only needs cells i-1 and i of diagonal d-1
+// and cell i-1 of diagonal d-2. Indexing the diagonals by row, all the
+// operands of LANES consecutive cells are LANES consecutive values, except
+// the bytes of b, that are consecutive backwards: V::Cost loads them in
+// one go and reverses them with a byte shuffle.
+//
+// The cells are stored with saturating arithmetic on T: min and +1 commute
+// with saturation, so every cell holds min(D, MAX) and the result is exact
+// when it is below MAX.
+
+#ifndef _LEV_SIMD_KERNEL_H_
+#define _LEV_SIMD_KERNEL_H_
+
+#include <stdint.h>
+#include "lev_simd_entry.h"
+
+namespace {
+
+template <typename T> inline T MinOf(T a, T b) {
+    return b < a ? b : a;
+}
+
+template <typename T> inline T MaxOf(T a, T b) {
+    return a < b ? b : a;
+}
+
+// Scalar version of the kernel step, for the cells that don't fill a vector.
+template <typename T> inline T SaturatedCell(T up, T left, T diag, int cost,
+                                             T max) {
+    uint64_t curr = MinOf(uint64_t(MinOf(up, left))+1, uint64_t(diag)+cost);
+    return T(MinOf(curr, uint64_t(max)));
+}
+
+// V describes the vector unit: the cell type T, LANES cells per vector,
+// MAX the saturation value and the load/store/min/add/cost operations.
+// V::Cost(a, b, one) compares a[k] with b[LANES-1-k] for every lane k.
+//
+// Returns the distance between a (m bytes) and b (n bytes), or -1 if it
+// doesn't fit in V::T. Requires 0 < m <= n and 3*(m+1) cells of scratch.
+template <typename V> int64_t DiagonalLevDistance(const unsigned char* a,
+                                                  int64_t m,
+                                                  const unsigned char* b,
+                                                  int64_t n,
+                                                  typename V::T* cells) {
+    typedef typename V::T T;
+    typedef typename V::Vec Vec;
+    const T max = V::MAX;
+    const Vec one = V::Set(1);
+
+    T* prev2 = cells;
+    T* prev = prev2+m+1;
+    T* curr = prev+m+1;
+
+    // Diagonal 0 is the single cell D[0][0] = 0
+    prev[0] = 0;
+    T prev_low = 0;
+    for (int64_t d=1; d <= m+n; ++d) {
+        const int64_t first = MaxOf(int64_t(0), d-n);
+        const int64_t last = MinOf(d, m);
+        // Cell i compares a[i-1] with bd[-i]
+        const unsigned char* bd = b+d-1;
+        T low = max;
+
+        int64_t i = first;
+        int64_t interior_last = last;
+        if (i == 0) { // First row: D[0][d] = d
+            curr[0] = T(MinOf(uint64_t(d), uint64_t(max)));
+            low = MinOf(low, curr[0]);
+            i = 1;
+        }
+        if (last == d) { // First column: D[d][0] = d
+            curr[d] = T(MinOf(uint64_t(d), uint64_t(max)));
+            low = MinOf(low, curr[d]);
+            interior_last = d-1;
+        }
+
+        Vec vlow = V::Set(max);
+        for (; i+V::LANES-1 <= interior_last; i += V::LANES) {
+            Vec up = V::Load(prev+i-1);
+            Vec left = V::Load(prev+i);
+            Vec diag = V::Load(prev2+i-1);
+            Vec cost = V::Cost(a+i-1, bd-i-(V::LANES-1), one);
+            Vec c = V::Min(V::Add(V::Min(up, left), one), V::Add(diag, cost));
+            V::Store(curr+i, c);
+            vlow = V::Min(vlow, c);
+        }
+        low = MinOf(low, V::HorizontalMin(vlow));
+        for (; i <= interior_last; ++i) {
+            curr[i] = SaturatedCell<T>(prev[i-1], prev[i], prev2[i-1],
+                                       a[i-1] != bd[-i] ? 1 : 0, max);
+            low = MinOf(low, curr[i]);
+        }
+
+        // Every path crosses one of two consecutive diagonals: if both of
+        // them are saturated, so is the result.
+        if (low == max && prev_low == max) {
+            return -1;
+        }
+        prev_low = low;
+
+        T* tmp = prev2;
+        prev2 = prev;
+        prev = curr;
+        curr = tmp;
+    }
+    return prev[m] == max ? -1 : int64_t(prev[m]);
+}
+
+// Runs the kernel with the narrowest cell type among the three given, on
+// the scratch buffer of the caller.
+template <typename V8, typename V16, typename V32>
+int64_t DiagonalLevDistance(const unsigned char* a, int64_t m,
+                            const unsigned char* b, int64_t n,
+                            int cell_bits, void* cells) {
+    switch (cell_bits) {
+        case 8:
+            return DiagonalLevDistance<V8>(a, m, b, n, (uint8_t*)cells);
+        case 16:
+            return DiagonalLevDistance<V16>(a, m, b, n, (uint16_t*)cells);
+        default:
+            return DiagonalLevDistance<V32>(a, m, b, n, (uint32_t*)cells);
+    }
+}
+
+} // namespace
+
+#endif
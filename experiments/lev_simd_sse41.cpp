@@ -0,0 +1,108 @@
+// Copyright 2012 - Stefano Brilli : stefanobrilli@gmail.com
+//
+// SSE4.1 instance of the anti-diagonal kernel: 16, 8 or 4 cells per vector.
+// This file is compiled with -msse4.1, call it only if the CPU supports it,
+// and include nothing but lev_simd_kernel.h (see lev_simd_entry.h).
+//
+// b is read backwards: pshufb reverses the bytes and, for the wider cells,
+// zero extends them in the same shuffle.
+//
+
+#include <smmintrin.h>
+#include "lev_simd_kernel.h"
+
+namespace {
+
+struct Sse41U8
+{
+    typedef uint8_t T;
+    typedef __m128i Vec;
+    static const int LANES = 16;
+    static const T MAX = 0xff;
+
+    static Vec Set(T v) { return _mm_set1_epi8(char(v)); }
+    static Vec Load(const T* p) { return _mm_loadu_si128((const Vec*)p); }
+    static void Store(T* p, Vec v) { _mm_storeu_si128((Vec*)p, v); }
+    static Vec Min(Vec a, Vec b) { return _mm_min_epu8(a, b); }
+    static Vec Add(Vec a, Vec b) { return _mm_adds_epu8(a, b); }
+    static Vec Cost(const unsigned char* a, const unsigned char* b, Vec one) {
+        const Vec reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                          7, 6, 5, 4, 3, 2, 1, 0);
+        Vec eq = _mm_cmpeq_epi8(
+            _mm_loadu_si128((const Vec*)a),
+            _mm_shuffle_epi8(_mm_loadu_si128((const Vec*)b), reverse));
+        return _mm_andnot_si128(eq, one);
+    }
+    static T HorizontalMin(Vec v) {
+        v = _mm_min_epu8(v, _mm_srli_si128(v, 8));
+        v = _mm_min_epu8(v, _mm_srli_si128(v, 4));
+        v = _mm_min_epu8(v, _mm_srli_si128(v, 2));
+        v = _mm_min_epu8(v, _mm_srli_si128(v, 1));
+        return T(_mm_extract_epi8(v, 0));
+    }
+};
+
+struct Sse41U16
+{
+    typedef uint16_t T;
+    typedef __m128i Vec;
+    static const int LANES = 8;
+    static const T MAX = 0xffff;
+
+    static Vec Set(T v) { return _mm_set1_epi16(short(v)); }
+    static Vec Load(const T* p) { return _mm_loadu_si128((const Vec*)p); }
+    static void Store(T* p, Vec v) { _mm_storeu_si128((Vec*)p, v); }
+    static Vec Min(Vec a, Vec b) { return _mm_min_epu16(a, b); }
+    static Vec Add(Vec a, Vec b) { return _mm_adds_epu16(a, b); }
+    static Vec Cost(const unsigned char* a, const unsigned char* b, Vec one) {
+        const Vec reverse = _mm_setr_epi8(7, -1, 6, -1, 5, -1, 4, -1,
+                                          3, -1, 2, -1, 1, -1, 0, -1);
+        Vec eq = _mm_cmpeq_epi16(
+            _mm_cvtepu8_epi16(_mm_loadl_epi64((const Vec*)a)),
+            _mm_shuffle_epi8(_mm_loadl_epi64((const Vec*)b), reverse));
+        return _mm_andnot_si128(eq, one);
+    }
+    static T HorizontalMin(Vec v) {
+        return T(_mm_cvtsi128_si32(_mm_minpos_epu16(v)));
+    }
+};
+
+struct Sse41U32
+{
+    typedef uint32_t T;
+    typedef __m128i Vec;
+    static const int LANES = 4;
+    static const T MAX = 0xffffffff;
+
+    static Vec Set(T v) { return _mm_set1_epi32(int(v)); }
+    static Vec Load(const T* p) { return _mm_loadu_si128((const Vec*)p); }
+    static void Store(T* p, Vec v) { _mm_storeu_si128((Vec*)p, v); }
+    static Vec Min(Vec a, Vec b) { return _mm_min_epu32(a, b); }
+    // SimdLevDistance only uses 32 bit cells for inputs below 4GB
+    static Vec Add(Vec a, Vec b) { return _mm_add_epi32(a, b); }
+    static Vec Cost(const unsigned char* a, const unsigned char* b, Vec one) {
+        const Vec reverse = _mm_setr_epi8(3, -1, -1, -1, 2, -1, -1, -1,
+                                          1, -1, -1, -1, 0, -1, -1, -1);
+        int wa, wb;
+        __builtin_memcpy(&wa, a, sizeof(wa));
+        __builtin_memcpy(&wb, b, sizeof(wb));
+        Vec eq = _mm_cmpeq_epi32(
+            _mm_cvtepu8_epi32(_mm_cvtsi32_si128(wa)),
+            _mm_shuffle_epi8(_mm_cvtsi32_si128(wb), reverse));
+        return _mm_andnot_si128(eq, one);
+    }
+    static T HorizontalMin(Vec v) {
+        v = _mm_min_epu32(v, _mm_srli_si128(v, 8));
+        v = _mm_min_epu32(v, _mm_srli_si128(v, 4));
+        return T(_mm_cvtsi128_si32(v));
+    }
+};
+
+} // namespace
+
+int64_t Sse41LevDistance(const unsigned char* a, int64_t m,
+                         const unsigned char* b, int64_t n, int cell_bits,
+                         void* cells) {
+    return DiagonalLevDistance<Sse41U8, Sse41U16, Sse41U32>(a, m, b, n,
+                                                            cell_bits, cells);
+}
@@ -0,0 +1,174 @@
+// Copyright 2012 - Stefano Brilli : stefanobrilli@gmail.com
+//
+// Token granularity Levenshtein distance (diff mode): the files are split in
+// lines or in whitespace separated words, every distinct token gets a 32 bit
+// id and the distance is computed over the arrays of ids. A text file of a
+// few MB has some 10^5 lines, so the matrix shrinks by orders of magnitude.
+//
+// Tokens are interned through a 64 bit hash, but two tokens share an id only
+// if their text is the same, so hash collisions never change the result.
+//
+// Operations: O(m*n) on the number of tokens, plus O(m+n) to intern them
+// Memory: O(m+n)
+
+#ifndef _LEV_TOKENS_H_
+#define _LEV_TOKENS_H_
+
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+
+enum TokenMode { TOKEN_LINES, TOKEN_WORDS };
+
+// Interns tokens: same text, same id.
+class TokenTable
+{
+public:
+    TokenTable() : slots(1024), used(0) {}
+
+    uint32_t Intern(const char* text, int64_t size) {
+        const uint64_t hash = Hash(text, size);
+        size_t mask = slots.size()-1;
+        size_t k = hash & mask;
+        while (slots[k].text != NULL) {
+            const Slot& s = slots[k];
+            if (s.hash == hash && s.size == size &&
+                memcmp(s.text, text, size) == 0) {
+                return s.id;
+            }
+            k = (k+1) & mask;
+        }
+
+        Slot& s = slots[k];
+        s.hash = hash;
+        s.text = text;
+        s.size = size;
+        s.id = uint32_t(used++);
+        const uint32_t id = s.id;
+        if (2*used > slots.size()) {
+            Grow();
+        }
+        return id;
+    }
+
+    size_t size() const {
+        return used;
+    }
+
+private:
+    struct Slot
+    {
+        Slot() : hash(0), text(NULL), size(0), id(0) {}
+        uint64_t hash;
+        const char* text; // Points inside the input, NULL for empty slots
+        int64_t size;
+        uint32_t id;
+    };
+
+    // FNV-1a
+    static uint64_t Hash(const char* text, int64_t size) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (int64_t i=0; i < size; ++i) {
+            hash = (hash ^ (unsigned char)text[i]) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    void Grow() {
+        std::vector<Slot> old(slots.size()*2);
+        old.swap(slots);
+        const size_t mask = slots.size()-1;
+        for (size_t i=0; i < old.size(); ++i) {
+            if (old[i].text != NULL) {
+                size_t k = old[i].hash & mask;
+                while (slots[k].text != NULL) {
+                    k = (k+1) & mask;
+                }
+                slots[k] = old[i];
+            }
+        }
+    }
+
+    std::vector<Slot> slots;
+    size_t used;
+};
+
+inline bool IsSpace(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Appends to tokens the ids of the tokens of data. Lines don't include
+// their '\n'; words are the runs of non whitespace bytes.
+inline void Tokenize(const char* data, int64_t size, TokenMode mode,
+                     TokenTable* table, std::vector<uint32_t>* tokens) {
+    int64_t i = 0;
+    while (i < size) {
+        int64_t start = i;
+        if (mode == TOKEN_LINES) {
+            const char* eol = (const char*)memchr(data+i, '\n', size-i);
+            i = eol != NULL ? eol-data : size;
+            tokens->push_back(table->Intern(data+start, i-start));
+            ++i;
+        } else {
+            while (i < size && !IsSpace(data[i])) {
+                ++i;
+            }
+            if (i > start) {
+                tokens->push_back(table->Intern(data+start, i-start));
+            }
+            ++i;
+        }
+    }
+}
+
+// Returns the Levenshtein distance between two arrays of token ids, with
+// the current/previous rows of LevDistance.
+inline int64_t TokenLevDistance(const uint32_t* a, int64_t m,
+                                const uint32_t* b, int64_t n) {
+    if (m < n) { // Rows along the shorter array
+        std::swap(a, b);
+        std::swap(m, n);
+    }
+    int64_t sz = n+1;
+    std::vector<int64_t> current(sz);
+    std::vector<int64_t> previous(sz);
+    for (int64_t i=0; i < sz; ++i) {
+        previous[i] = i;
+    }
+
+    for (int64_t i=0; i < m; ++i) {
+        const uint32_t t = a[i];
+        current[0] = i+1;
+        for (int64_t j=1 ; j < sz; ++j) {
+            current[j] = std::min( std::min(previous[j], current[j-1])+1,
+                previous[j-1]+(t != b[j-1] ? 1 : 0));
+        }
+        std::swap(current, previous);
+    }
+    return previous[sz-1];
+}
+
+// Returns the number of tokens (lines or words) to insert, delete or
+// replace to change file1_data into file2_data. If not NULL, tokens1 and
+// tokens2 receive the number of tokens of each file.
+inline int64_t TokenLevDistance(char* file1_data, int64_t file1_size,
+                                char* file2_data, int64_t file2_size,
+                                TokenMode mode, int64_t* tokens1=NULL,
+                                int64_t* tokens2=NULL) {
+    TokenTable table;
+    std::vector<uint32_t> a;
+    std::vector<uint32_t> b;
+    Tokenize(file1_data, file1_size, mode, &table, &a);
+    Tokenize(file2_data, file2_size, mode, &table, &b);
+    if (tokens1 != NULL) {
+        *tokens1 = a.size();
+    }
+    if (tokens2 != NULL) {
+        *tokens2 = b.size();
+    }
+    return TokenLevDistance(a.empty() ? NULL : &a[0], a.size(),
+                            b.empty() ? NULL : &b[0], b.size());
+}
+
+#endif
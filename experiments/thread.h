@@ -204,32 +204,50 @@ template <typename T> struct _thread
 {
     // This struct will hold the return value of the thread called func.
     
-    _thread() : counter(0)
+    _thread() : counter(0), joinable(false)
     {
         pthread_attr_init(&attr);
         pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
     }
 
-    ~_thread() { pthread_detach(thd); }
+    ~_thread()
+    {
+        // Only a thread that was never joined is still ours to detach.
+        if (joinable)
+            pthread_detach(thd);
+        pthread_attr_destroy(&attr);
+    }
 
     T result;
     pthread_t thd;
     pthread_attr_t attr;
     volatile int counter;
+    bool joinable;
 
-    int join() { return pthread_join(thd, NULL); }
+    int join()
+    {
+        if (!joinable)
+            return 0;
+        int ret = pthread_join(thd, NULL);
+        if (ret == 0 || ret == ESRCH)
+            joinable = false;
+        return ret;
+    }
     int start(void*(f)(void*), void* v)
     {
-        return pthread_create(&thd, &attr, f, v);
+        int ret = pthread_create(&thd, &attr, f, v);
+        joinable = (ret == 0);
+        return ret;
     }
     
     // Atomic function for add and sub
     int inc() { return __sync_fetch_and_add(&counter, 1); }
     int dec()
     {
-        if (__sync_fetch_and_sub(&counter, 1) == 0)
+        int left = __sync_sub_and_fetch(&counter, 1);
+        if (left == 0)
             delete this;
-        return counter;
+        return left;
     }
 
     private:
@@ -255,10 +273,9 @@ template <typename T> struct Result
         thd->inc();
     }
 
-    Result(const Result<T>& o)
+    Result(const Result<T>& o) : thd(o.thd)
     {
         thd->inc();
-        thd = o.thd;
     }
 
     Result<T>& operator=(const Result& o)
@@ -582,13 +599,20 @@ public:
     }
 
 protected:
-    template <typename T, typename F> static _thread<T>*
+    template <typename T, typename F> static Result<T>
     _start(const F& functor)
     {
+        // The caller's reference is taken before the thread runs, so a
+        // worker that returns at once can't drop the last one.
         _thread<T>* mythread = new _thread<T>();
+        Result<T> r(mythread);
         _help_st<T, F >* h2 = new _help_st<T, F>(mythread, functor);
-        mythread->start(_help_fn<_help_st<T, F> >, h2);
-        return mythread;
+        if (mythread->start(_help_fn<_help_st<T, F> >, h2) != 0)
+        {
+            delete h2;
+            throw std::runtime_error("pthread_create failed");
+        }
+        return r;
     }
 
 };